@@ -41,6 +41,32 @@ input_getc (void)
   return key;
 }
 
+/* Reads up to SIZE keys from the input buffer into BUF and
+   returns the number read.  Waits for the first key, then takes
+   whatever else is already buffered in one go, like a terminal
+   in line mode: it stops after a new-line, so that each call
+   returns at most one line.  Keys are returned as typed, without
+   echo or erase handling, which are left to the reader, as
+   examples/shell.c does. */
+size_t
+input_getbuf (uint8_t *buf, size_t size) 
+{
+  enum intr_level old_level;
+  size_t n = 0;
+
+  if (size == 0)
+    return 0;
+
+  old_level = intr_disable ();
+  buf[n++] = intq_getc (&buffer);
+  if (buf[0] != '\n')
+    n += intq_getbuf (&buffer, buf + 1, size - 1, '\n');
+  serial_notify ();
+  intr_set_level (old_level);
+
+  return n;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
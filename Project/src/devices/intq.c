@@ -54,6 +54,30 @@ intq_getc (struct intq *q)
   return byte;
 }
 
+/* Removes up to SIZE bytes from Q into BUF, without sleeping,
+   and returns the number removed.  Stops early, after removing
+   it, at the first byte equal to DELIM, unless DELIM is -1.
+   May be called from an interrupt handler. */
+size_t
+intq_getbuf (struct intq *q, uint8_t *buf, size_t size, int delim) 
+{
+  size_t n = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  while (n < size && !intq_empty (q)) 
+    {
+      uint8_t byte = q->buf[q->tail];
+      q->tail = next (q->tail);
+      buf[n++] = byte;
+      if (byte == delim)
+        break;
+    }
+
+  if (n > 0)
+    signal (q, &q->not_full);
+  return n;
+}
+
 /* Adds BYTE to the end of Q.
    If Q is full, sleeps until a byte is removed.
    When called from an interrupt handler, Q must not be full. */
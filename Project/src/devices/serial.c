@@ -44,6 +44,16 @@
 /* MODEM Control Register. */
 #define MCR_OUT2 0x08           /* Output line 2. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable transmit and receive FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if the FIFOs are enabled. */
+
+/* Transmit FIFO depth of the 16550A. */
+#define TX_FIFO_SIZE 16
+
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
@@ -54,6 +64,11 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Number of bytes the transmitter accepts each time it reports
+   that its holding register is empty: 1 without FIFOs,
+   TX_FIFO_SIZE with them. */
+static int tx_burst = 1;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -88,6 +103,15 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
+
+  /* Turn on the FIFOs, if the UART has them, so that each transmit
+     interrupt can hand the hardware a whole run of bytes. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    tx_burst = TX_FIFO_SIZE;
+  else
+    outb (FCR_REG, 0);
+
   mode = QUEUE;
   old_level = intr_disable ();
   write_ier ();
@@ -129,6 +153,50 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port.
+   Equivalent to calling serial_putc() for each byte, but queues
+   the whole run with interrupts disabled once and updates the
+   interrupt enable register only when needed, leaving the
+   transmit interrupt to drain it. */
+void
+serial_putbuf (const char *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (n-- > 0)
+        putc_poll (*buffer++);
+    }
+  else
+    {
+      while (n-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* Can't wait with interrupts off; see
+                     serial_putc(). */
+                  putc_poll (intq_getc (&txq));
+                }
+              else
+                {
+                  /* Make sure the transmit interrupt is on
+                     before intq_putc() sleeps waiting for it. */
+                  write_ier ();
+                }
+            }
+          intq_putc (&txq, *buffer++);
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -219,9 +287,15 @@ serial_interrupt (struct intr_frame *f UNUSED)
     input_putc (inb (RBR_REG));
 
   /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
+     ready to accept bytes for transmission, transmit as many as
+     its FIFO holds. */
   while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+    {
+      int i;
+
+      for (i = 0; i < tx_burst && !intq_empty (&txq); i++)
+        outb (THR_REG, intq_getc (&txq));
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
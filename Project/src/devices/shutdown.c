@@ -5,9 +5,12 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -135,7 +138,10 @@ print_stats (void)
 #endif
   console_print_stats ();
   kbd_print_stats ();
+  palloc_print_stats ();
+  slab_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
 #endif
 }
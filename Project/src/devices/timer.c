@@ -1,6 +1,7 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
@@ -20,6 +21,60 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Microseconds per timer tick. */
+#define TICK_USECS (1000000 / TIMER_FREQ)
+
+/* Number of timer ticks over which timer_calibrate() times the
+   CPU's time-stamp counter. */
+#define TSC_CALIBRATION_TICKS 4
+
+/* Time-stamp counter calibration, set by timer_calibrate().
+   TSC_HZ is the number of TSC cycles per second, or 0 until it is
+   known.  TSC_BASE is a TSC reading taken USECS_BASE microseconds
+   after boot. */
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static int64_t usecs_base;
+
+/* Time of the latest timer interrupt, in microseconds since
+   boot. */
+static int64_t last_tick_usecs;
+
+/* Threads sleeping in timer_sleep(), in order of wake-up time,
+   so that the timer interrupt only has to look at the front. */
+static struct list sleep_list;
+
+/* Threads sleeping for less than a tick in real_time_sleep(), in
+   order of wake-up time.  A timer tick would wake them up to a
+   whole tick late, so when the first of them is due before the
+   next tick, the PIT is switched to a single count that runs out
+   at its deadline, and the timer interrupt at its end counts out
+   the rest of the tick. */
+static struct list shot_list;
+
+/* PIT cycles left in the current tick after the count started by
+   start_shot() runs out, or 0 if there is no such count. */
+static int shot_rest;
+
+/* Tickless idle.
+
+   While the idle thread is waiting for an interrupt, the PIT is
+   switched from periodic mode to a single count that lasts until
+   the next thread is due to wake up, so that an idle machine is
+   not interrupted TIMER_FREQ times per second for nothing.  The
+   count ends on a tick boundary, and the timer interrupt at its
+   end makes up for the ticks that were skipped.  The PIT's 16-bit
+   counter limits the count to TICKLESS_MAX_TICKS ticks. */
+#define TICK_PIT_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define TICKLESS_MAX_TICKS (65535 / TICK_PIT_COUNT)
+
+/* Ticks covered by the count in progress, or 0 if the PIT is in
+   periodic mode. */
+static int64_t tickless_ticks;
+
+/* PIT count that the count in progress started from. */
+static uint16_t tickless_count;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,6 +84,22 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static list_less_func wakes_earlier;
+static void sleep_until (struct list *, int64_t wake_usecs);
+static void wake_sleepers (struct list *, int64_t now);
+static bool start_shot (int to_tick);
+static void rearm_shot (void);
+static int64_t tsc_to_usecs (uint64_t cycles);
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -36,14 +107,20 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleep_list);
+  list_init (&shot_list);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the time-stamp counter, used by timer_usecs(). */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  uint64_t start_tsc, end_tsc;
+  enum intr_level old_level;
+  int64_t start;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
@@ -63,7 +140,24 @@ timer_calibrate (void)
     if (!too_many_loops (loops_per_tick | test_bit))
       loops_per_tick |= test_bit;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  /* Count TSC cycles between timer ticks. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start_tsc = rdtsc ();
+  start = ticks;
+  while (ticks < start + TSC_CALIBRATION_TICKS)
+    barrier ();
+  end_tsc = rdtsc ();
+
+  old_level = intr_disable ();
+  tsc_base = end_tsc;
+  usecs_base = (start + TSC_CALIBRATION_TICKS) * TICK_USECS;
+  tsc_hz = (end_tsc - start_tsc) * TIMER_FREQ / TSC_CALIBRATION_TICKS;
+  intr_set_level (old_level);
+
+  printf ("%'"PRIu64" loops/s, %'"PRIu64" TSC cycles/s.\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,24 +178,142 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of microseconds since the OS booted.  Until
+   timer_calibrate() has run, the result only advances once per
+   timer tick. */
+int64_t
+timer_usecs (void)
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * TICK_USECS;
+  return usecs_base + tsc_to_usecs (rdtsc () - tsc_base);
+}
+
+/* Converts CYCLES time-stamp counter cycles to microseconds,
+   without overflowing for any realistic uptime. */
+static int64_t
+tsc_to_usecs (uint64_t cycles)
+{
+  return (cycles / tsc_hz * 1000000
+          + cycles % tsc_hz * 1000000 / tsc_hz);
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  /* Set sleeping time and prepare to sleep. */
-  struct thread *sleep_thread = thread_current ();
-  sleep_thread->time_awake = start + ticks;
-  enum intr_level old_level = intr_disable ();
-  sleep_thread->sleep = true;
-  /* Put thread in waiting queue to avoid busy waiting. */
-  thread_block();
+  if (ticks <= 0)
+    return;
+
+  /* Aim halfway between the target tick and the one before it, so
+     that jitter in when interrupts arrive cannot move the wake-up
+     to another tick. */
+  old_level = intr_disable ();
+  sleep_until (&sleep_list,
+               last_tick_usecs + ticks * TICK_USECS - TICK_USECS / 2);
   intr_set_level (old_level);
 }
 
+/* Blocks the current thread on LIST until the first timer
+   interrupt at or after WAKE_USECS microseconds since boot.
+   Interrupts must be off. */
+static void
+sleep_until (struct list *list, int64_t wake_usecs)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cur->wake_usecs = wake_usecs;
+  list_insert_ordered (list, &cur->elem, wakes_earlier, NULL);
+  if (list == &shot_list && list_front (list) == &cur->elem)
+    rearm_shot ();
+  thread_block ();
+}
+
+/* Wakes up the threads on LIST that are due by NOW, in
+   microseconds since boot. */
+static void
+wake_sleepers (struct list *list, int64_t now)
+{
+  while (!list_empty (list))
+    {
+      struct thread *t = list_entry (list_front (list),
+                                     struct thread, elem);
+      if (t->wake_usecs > now)
+        break;
+      list_pop_front (list);
+      thread_unblock (t);
+    }
+}
+
+/* Starts a single count on the PIT that runs out when the first
+   thread on shot_list is due, if that comes sooner than TO_TICK
+   PIT cycles from now, when the next tick is due.  Returns true
+   if it started one.  Interrupts must be off. */
+static bool
+start_shot (int to_tick)
+{
+  struct thread *t;
+  int64_t wait;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&shot_list))
+    return false;
+  t = list_entry (list_front (&shot_list), struct thread, elem);
+  wait = (t->wake_usecs - timer_usecs ()) * PIT_HZ / 1000000;
+  if (wait >= to_tick)
+    return false;
+  if (wait < 1)
+    wait = 1;
+  shot_rest = to_tick - wait;
+  tickless_ticks = 0;
+  pit_start_one_shot (0, wait);
+  return true;
+}
+
+/* Moves the count started by start_shot() earlier, or starts one,
+   after a thread has gone to the front of shot_list.  Interrupts
+   must be off. */
+static void
+rearm_shot (void)
+{
+  int count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Only the idle thread runs while a tickless count of more than
+     one tick is in progress. */
+  if (tickless_ticks > 1)
+    return;
+
+  /* Leave a single count that has run out to the pending
+     interrupt, which rearms in turn.  The counter goes on counting
+     down after it wraps, so ask the PIT's output instead, after
+     reading the count so that the count cannot be a wrapped one. */
+  count = pit_read_count (0);
+  if ((shot_rest > 0 || tickless_ticks == 1) && pit_output (0))
+    return;
+  start_shot (count + shot_rest);
+}
+
+/* Returns true if the thread owning list element A wakes up
+   before the one owning B. */
+static bool
+wakes_earlier (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wake_usecs < b->wake_usecs;
+}
+
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void
@@ -165,6 +377,99 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Switches the PIT to a single count that lasts until the next
+   sleeping thread is due, or as long as the PIT allows, instead
+   of interrupting every tick.  Called by the idle thread, with
+   interrupts off, just before it waits for an interrupt. */
+void
+timer_tickless_enter (void)
+{
+  int64_t span = TICKLESS_MAX_TICKS;
+  uint16_t remaining;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tickless_ticks > 0 || shot_rest > 0)
+    return;
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      int64_t wait = DIV_ROUND_UP (t->wake_usecs - last_tick_usecs,
+                                   TICK_USECS);
+      if (wait < span)
+        span = wait;
+    }
+  if (!list_empty (&shot_list))
+    {
+      /* Stop at the last tick before the deadline, whose timer
+         interrupt starts a count that ends at it. */
+      struct thread *t = list_entry (list_front (&shot_list),
+                                     struct thread, elem);
+      int64_t wait = (t->wake_usecs - last_tick_usecs) / TICK_USECS;
+      if (wait < span)
+        span = wait;
+    }
+  /* The multi-level feedback queue scheduler does its bookkeeping
+     on each second's tick, so don't skip those. */
+  if (thread_mlfqs && TIMER_FREQ - ticks % TIMER_FREQ < span)
+    span = TIMER_FREQ - ticks % TIMER_FREQ;
+  if (span <= 1)
+    return;
+
+  /* Finish the current tick, then count SPAN - 1 more. */
+  remaining = pit_read_count (0);
+  if (remaining == 0 || remaining > TICK_PIT_COUNT)
+    return;
+  tickless_ticks = span;
+  tickless_count = remaining + (span - 1) * TICK_PIT_COUNT;
+  pit_start_one_shot (0, tickless_count);
+}
+
+/* Switches the PIT back to periodic mode if it is running a count
+   started by timer_tickless_enter() that has not yet run out,
+   crediting the whole ticks that have passed, as idle time.
+   Called with interrupts off whenever the idle thread gives up
+   the CPU.  If the count has run out, the timer interrupt, which
+   is pending if it has not run already, does the same instead. */
+void
+timer_tickless_exit (void)
+{
+  int count, elapsed, first;
+  int64_t passed = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* A count that only finishes the current tick, started by the
+     timer interrupt at the end of a start_shot() count, is left
+     to run out. */
+  if (tickless_ticks <= 1)
+    return;
+
+  /* Once the count runs out, the counter wraps and goes on
+     counting down, so its value cannot tell whether it has.  The
+     PIT's output can: it rises when the count runs out, raising
+     the interrupt.  Read it after the count, so that a count read
+     before then is never a wrapped one. */
+  count = pit_read_count (0);
+  if (pit_output (0))
+    return;
+
+  /* The first tick ended FIRST PIT cycles into the count, and the
+     others every TICK_PIT_COUNT cycles after.  The fraction of a
+     tick that has passed since the last one is lost, so the tick
+     count falls slightly behind. */
+  elapsed = tickless_count - count;
+  first = tickless_count - (tickless_ticks - 1) * TICK_PIT_COUNT;
+  if (elapsed >= first)
+    passed = (elapsed - first) / TICK_PIT_COUNT + 1;
+  ticks += passed;
+  thread_idle_ticks (passed);
+  last_tick_usecs = timer_usecs ();
+  tickless_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -176,13 +481,47 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
+  if (shot_rest > 0)
+    {
+      /* End of a count started by start_shot(), partway through a
+         tick.  Wake up the threads that are due, then count out
+         the rest of the tick, stopping on the way for the next
+         sleeper that is due before it ends. */
+      int to_tick = shot_rest;
+
+      shot_rest = 0;
+      wake_sleepers (&shot_list, timer_usecs ());
+      if (!start_shot (to_tick))
+        {
+          tickless_ticks = 1;
+          tickless_count = to_tick;
+          pit_start_one_shot (0, tickless_count);
+        }
+      return;
+    }
+
+  if (tickless_ticks > 0)
+    {
+      /* End of a count started by timer_tickless_enter().  The
+         idle thread ran throughout, and thread_tick() below
+         counts the last tick. */
+      ticks += tickless_ticks;
+      thread_idle_ticks (tickless_ticks - 1);
+      tickless_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  else
+    ticks++;
+  last_tick_usecs = timer_usecs ();
+
+  /* Wake up the threads whose time has come, and have the PIT
+     interrupt again for the next short sleeper due before the
+     next tick. */
+  wake_sleepers (&sleep_list, last_tick_usecs);
+  wake_sleepers (&shot_list, last_tick_usecs);
+  start_shot (TICK_PIT_COUNT);
+
   thread_tick ();
-  /* Newly added. */
-  enum intr_level old_level;
-  old_level = intr_disable ();
-  thread_foreach(thread_waking, &ticks);
-  intr_set_level (old_level);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -218,31 +557,54 @@ busy_wait (int64_t loops)
     barrier ();
 }
 
-/* Sleep for approximately NUM/DENOM seconds. */
+/* Sleep for at least NUM/DENOM seconds. */
 static void
 real_time_sleep (int64_t num, int32_t denom) 
 {
-  /* Convert NUM/DENOM seconds into timer ticks, rounding down.
-          
-        (NUM / DENOM) s          
-     ---------------------- = NUM * TIMER_FREQ / DENOM ticks. 
-     1 s / TIMER_FREQ ticks
-  */
-  int64_t ticks = num * TIMER_FREQ / denom;
+  enum intr_level old_level;
+  int64_t usecs, deadline;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  ASSERT (denom % 1000 == 0);
+
+  if (tsc_hz == 0)
+    {
+      /* No clock finer than a tick yet.  Convert NUM/DENOM
+         seconds into timer ticks, rounding down.
+
+            (NUM / DENOM) s
+         ---------------------- = NUM * TIMER_FREQ / DENOM ticks.
+         1 s / TIMER_FREQ ticks
+      */
+      int64_t ticks = num * TIMER_FREQ / denom;
+
+      if (ticks > 0)
+        timer_sleep (ticks);
+      else
+        real_time_delay (num, denom);
+      return;
+    }
+
+  /* Convert NUM/DENOM seconds into microseconds, rounding up.
+     Scale DENOM down by 1000 to avoid overflow. */
+  usecs = DIV_ROUND_UP (num * 1000, denom / 1000);
+  deadline = timer_usecs () + usecs;
+  if (usecs >= TICK_USECS)
     {
-      /* We're waiting for at least one full timer tick.  Use
-         timer_sleep() because it will yield the CPU to other
-         processes. */                
-      timer_sleep (ticks); 
+      /* Block until the first timer interrupt past the deadline,
+         yielding the CPU to other processes. */
+      old_level = intr_disable ();
+      sleep_until (&sleep_list, deadline);
+      intr_set_level (old_level);
     }
-  else 
+  else
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
-      real_time_delay (num, denom); 
+      /* A timer tick could only end the sleep up to a whole tick
+         late, so block until the PIT interrupts at the deadline
+         instead. */
+      old_level = intr_disable ();
+      sleep_until (&shot_list, deadline);
+      intr_set_level (old_level);
     }
 }
 
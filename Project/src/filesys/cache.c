@@ -11,7 +11,7 @@ struct cache_block
     bool dirty;                         /* Whether the cache line is dirty.*/
     bool valid;                         /* Whether the cache line is valid.*/
     block_sector_t disk_sector;         /* The cooresponding block sector on disk. */
-    int64_t time;                       /* Most recently use time. */
+    int64_t time;                       /* Most recently use time, in microseconds. */
     struct semaphore sema;              /* Semaphore for this cache line. */
     struct block *block;                /* Which block(device), in this project, always fs_device. */
     char disk_data[BLOCK_SECTOR_SIZE];  /* The cached BLOCK_SECTOR_SIZE size date. */
@@ -81,7 +81,7 @@ cache_read (struct block *block, block_sector_t sector, void *buffer)
   /* Copy data to destination buffer. */
   memcpy (buffer, cache_line -> disk_data, BLOCK_SECTOR_SIZE);
   /* Update the most recent access time. */
-  cache_line -> time = timer_ticks ();
+  cache_line -> time = timer_usecs ();
   /* Finish usage of the cache line. */
   sema_up (&cache_line -> sema);
   /* Produce a read-ahead operation and push it to read-ahead buffer. */
@@ -106,7 +106,7 @@ cache_write (struct block *block, block_sector_t sector, const void *buffer)
   /* Write to cache. */
   memcpy (cache_line -> disk_data, buffer, BLOCK_SECTOR_SIZE);
   /* Update the most recently access time. */
-  cache_line -> time = timer_ticks ();
+  cache_line -> time = timer_usecs ();
   /* Write operation, the cache line is dirty. */
   cache_line -> dirty = true;
   /* Finish usage of the cache line. */
@@ -134,7 +134,7 @@ choose_evict ()
 {
   struct cache_block *evict = NULL;
   /* LRU is used to evict cache line. */
-  int64_t earlist_time = timer_ticks ();
+  int64_t earlist_time = timer_usecs ();
   for (struct cache_block *cache_line = cache; cache_line < cache + CACHE_SIZE; cache_line++)
   {
     /* We set sema_down in choose_evict, the caller should sema_up the cache line after usage. */
@@ -59,6 +59,12 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* True (the default) to echo console output to the VGA display
+   as well as the serial port.  Drawing on the VGA display costs
+   port I/O for every character written, which is wasted when
+   nobody is looking at the screen. */
+static bool use_vga = true;
+
 /* Enable console locking. */
 void
 console_init (void) 
@@ -76,6 +82,13 @@ console_panic (void)
   use_console_lock = false;
 }
 
+/* Stops echoing console output to the VGA display. */
+void
+console_disable_vga (void) 
+{
+  use_vga = false;
+}
+
 /* Prints console statistics. */
 void
 console_print_stats (void) 
@@ -148,13 +161,16 @@ puts (const char *s)
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.
+   The whole run is handed to each output device at once. */
 void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  write_cnt += n;
+  serial_putbuf (buffer, n);
+  if (use_vga)
+    vga_putbuf (buffer, n);
   release_console ();
 }
 
@@ -187,5 +203,6 @@ putchar_have_lock (uint8_t c)
   ASSERT (console_locked_by_current_thread ());
   write_cnt++;
   serial_putc (c);
-  vga_putc (c);
+  if (use_vga)
+    vga_putc (c);
 }
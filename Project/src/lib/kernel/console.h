@@ -3,6 +3,7 @@
 
 void console_init (void);
 void console_panic (void);
+void console_disable_vga (void);
 void console_print_stats (void);
 
 #endif /* lib/kernel/console.h */
@@ -428,3 +428,310 @@ remove_elem (struct hash *h, struct hash_elem *e)
   list_remove (&e->list_elem);
 }
 
+/* Open-addressing hash table. */
+
+/* Initial number of slots. */
+#define OHASH_MIN_SLOTS 16
+
+/* The table grows when more than OHASH_MAX_LOAD / 8 of its slots
+   are in use. */
+#define OHASH_MAX_LOAD 7
+
+static bool ohash_find_slot (struct ohash *, struct hash_elem *,
+                             unsigned hash, size_t *slot);
+static void ohash_place (struct ohash *, struct ohash_slot);
+static bool ohash_grow (struct ohash *);
+
+/* Initializes open-addressing hash table H to compute hash
+   values using HASH and compare hash elements using LESS, given
+   auxiliary data AUX.  Returns false if memory for the slots
+   cannot be allocated, leaving H empty and safe to destroy. */
+bool
+ohash_init (struct ohash *h,
+            hash_hash_func *hash, hash_less_func *less, void *aux) 
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = OHASH_MIN_SLOTS;
+  h->slots = malloc (sizeof *h->slots * h->slot_cnt);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  if (h->slots != NULL) 
+    {
+      ohash_clear (h, NULL);
+      return true;
+    }
+  else
+    {
+      h->slot_cnt = 0;
+      return false;
+    }
+}
+
+/* Removes all the elements from H, calling DESTRUCTOR, if it is
+   non-null, for each of them.  The same restrictions apply as
+   for hash_clear(). */
+void
+ohash_clear (struct ohash *h, hash_action_func *destructor) 
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++) 
+    {
+      struct hash_elem *e = h->slots[i].elem;
+
+      h->slots[i].elem = NULL;
+      if (e != NULL && destructor != NULL)
+        destructor (e, h->aux);
+    }
+
+  h->elem_cnt = 0;
+}
+
+/* Destroys H, first calling DESTRUCTOR, if it is non-null, for
+   each element.  The same restrictions apply as for
+   hash_destroy(). */
+void
+ohash_destroy (struct ohash *h, hash_action_func *destructor) 
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->slots);
+}
+
+/* Inserts NEW into H and returns a null pointer, if no equal
+   element is already in the table.  If an equal element is
+   already in the table, returns it without inserting NEW.
+   If the table is full and cannot grow for lack of memory,
+   returns NEW itself without inserting it. */
+struct hash_elem *
+ohash_insert (struct ohash *h, struct hash_elem *new) 
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t slot;
+
+  if (ohash_find_slot (h, new, hash, &slot))
+    return h->slots[slot].elem;
+  if (!ohash_grow (h))
+    return new;
+
+  ohash_place (h, (struct ohash_slot) { hash, new });
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Inserts NEW into H, replacing any equal element already in the
+   table, which is returned.  If there was no equal element and
+   the table is full and cannot grow for lack of memory, returns
+   NEW itself without inserting it. */
+struct hash_elem *
+ohash_replace (struct ohash *h, struct hash_elem *new) 
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t slot;
+
+  if (ohash_find_slot (h, new, hash, &slot))
+    {
+      struct hash_elem *old = h->slots[slot].elem;
+      h->slots[slot].elem = new;
+      return old;
+    }
+  return ohash_insert (h, new);
+}
+
+/* Finds and returns an element equal to E in H, or a null
+   pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *h, struct hash_elem *e) 
+{
+  size_t slot;
+
+  if (ohash_find_slot (h, e, h->hash (e, h->aux), &slot))
+    return h->slots[slot].elem;
+  return NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in H.
+   Returns a null pointer if no equal element existed in the
+   table.  The caller remains responsible for the element's
+   memory, as for hash_delete(). */
+struct hash_elem *
+ohash_delete (struct ohash *h, struct hash_elem *e) 
+{
+  size_t mask = h->slot_cnt - 1;
+  struct hash_elem *found;
+  size_t slot, next;
+
+  if (!ohash_find_slot (h, e, h->hash (e, h->aux), &slot))
+    return NULL;
+  found = h->slots[slot].elem;
+
+  /* Shift the following elements back by one slot, until an
+     empty slot or an element already in its home slot, so that
+     no probe sequence has a hole in it. */
+  for (next = (slot + 1) & mask; h->slots[next].elem != NULL
+         && (h->slots[next].hash & mask) != next;
+       next = (next + 1) & mask) 
+    {
+      h->slots[slot] = h->slots[next];
+      slot = next;
+    }
+  h->slots[slot].elem = NULL;
+  h->elem_cnt--;
+  return found;
+}
+
+/* Calls ACTION for each element in H in arbitrary order.  The
+   same restrictions apply as for hash_apply(). */
+void
+ohash_apply (struct ohash *h, hash_action_func *action) 
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      action (h->slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating H, in the same way as
+   hash_first(). */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h) 
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->slot = 0;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it, or returns a null pointer if no elements are left, in the
+   same way as hash_next(). */
+struct hash_elem *
+ohash_next (struct ohash_iterator *i) 
+{
+  ASSERT (i != NULL);
+
+  i->elem = NULL;
+  while (i->slot < i->hash->slot_cnt)
+    {
+      struct hash_elem *e = i->hash->slots[i->slot++].elem;
+      if (e != NULL)
+        {
+          i->elem = e;
+          break;
+        }
+    }
+  return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct hash_elem *
+ohash_cur (struct ohash_iterator *i) 
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h) 
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h) 
+{
+  return h->elem_cnt == 0;
+}
+
+/* Searches H for an element equal to E, whose hash value is
+   HASH.  If there is one, stores its slot in *SLOT and returns
+   true; otherwise returns false. */
+static bool
+ohash_find_slot (struct ohash *h, struct hash_elem *e, unsigned hash,
+                 size_t *slot) 
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t i = hash & mask;
+  size_t dist;
+
+  for (dist = 0; h->slots[i].elem != NULL; dist++, i = (i + 1) & mask) 
+    {
+      struct ohash_slot *s = &h->slots[i];
+
+      /* Any equal element would have displaced one this close to
+         its home slot. */
+      if (((i - s->hash) & mask) < dist)
+        break;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        {
+          *slot = i;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Puts NEW into H, which must have an empty slot and no element
+   equal to NEW's.  NEW takes the slot of the first element that
+   is closer to its home slot, which is then moved on in turn. */
+static void
+ohash_place (struct ohash *h, struct ohash_slot new) 
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t i = new.hash & mask;
+  size_t dist;
+
+  for (dist = 0; h->slots[i].elem != NULL; dist++, i = (i + 1) & mask) 
+    {
+      size_t slot_dist = (i - h->slots[i].hash) & mask;
+      if (slot_dist < dist) 
+        {
+          struct ohash_slot t = h->slots[i];
+          h->slots[i] = new;
+          new = t;
+          dist = slot_dist;
+        }
+    }
+  h->slots[i] = new;
+}
+
+/* Makes sure that H has room for one more element, doubling its
+   slot array if it is too full.  Returns false only if H is full
+   and cannot grow for lack of memory; if it merely fails to
+   grow, lookups get slower but the table still works. */
+static bool
+ohash_grow (struct ohash *h) 
+{
+  struct ohash_slot *old_slots = h->slots;
+  size_t old_slot_cnt = h->slot_cnt;
+  struct ohash_slot *new_slots;
+  size_t i;
+
+  if ((h->elem_cnt + 1) * 8 <= h->slot_cnt * OHASH_MAX_LOAD)
+    return true;
+
+  new_slots = malloc (sizeof *new_slots * old_slot_cnt * 2);
+  if (new_slots == NULL)
+    return h->elem_cnt + 1 < h->slot_cnt;
+
+  h->slots = new_slots;
+  h->slot_cnt = old_slot_cnt * 2;
+  for (i = 0; i < h->slot_cnt; i++)
+    h->slots[i].elem = NULL;
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      ohash_place (h, old_slots[i]);
+  free (old_slots);
+  return true;
+}
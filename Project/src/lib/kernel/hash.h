@@ -18,7 +18,26 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   There is also an open-addressing variant, struct ohash, with
+   the same interface under the prefix "ohash_".  It takes the
+   same struct hash_elem and the same hash and comparison
+   functions, so a table can be switched from one to the other
+   without touching its elements.  Instead of bucket lists, it
+   keeps one array of slots, each holding an element pointer and
+   that element's hash value, and resolves collisions by linear
+   probing with "Robin Hood" displacement: an element being
+   inserted takes the slot of any element that is closer to its
+   home slot than the new one is to its own.  That keeps probe
+   sequences short even at high load, so that a lookup usually
+   reads one or two adjacent slots, and compares the stored hash
+   before calling the comparison function.  Growing the table
+   moves slots, not list elements.
+
+   The trade-off is that the slot array is allocated memory that
+   must grow as the table does, so ohash_insert() can fail, and
+   that it never shrinks. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -95,6 +114,54 @@ struct hash_elem *hash_cur (struct hash_iterator *);
 size_t hash_size (struct hash *);
 bool hash_empty (struct hash *);
 
+/* A slot in an open-addressing hash table. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    struct hash_elem *elem;     /* Element, or a null pointer if empty. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    size_t slot;                /* Current slot. */
+    struct hash_elem *elem;     /* Current hash element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_replace (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, struct hash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, hash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct hash_elem *ohash_next (struct ohash_iterator *);
+struct hash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
 /* Sample hash functions. */
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
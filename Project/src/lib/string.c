@@ -1,5 +1,19 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* The block functions below move whole words where they can.
+   Blocks shorter than this are handled a byte at a time, since
+   the string instructions take a while to get going.
+
+   There are no SSE versions: the kernel is compiled with
+   -msoft-float and does not save FPU or SSE state on a context
+   switch or an interrupt. */
+#define BLOCK_OP_MIN 16
+
+/* A word that may be read from any address and may alias any
+   other type. */
+typedef uint32_t word_t __attribute__ ((may_alias));
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +26,22 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= BLOCK_OP_MIN) 
+    {
+      /* Copy bytes up to a word boundary in DST, then words. */
+      size_t head = -(uintptr_t) dst % sizeof (word_t);
+      size_t words;
+
+      size -= head;
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      asm volatile ("rep movsb\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (head)
+                    : "r" (words)
+                    : "memory");
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -29,20 +59,41 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
+  /* A forward copy is safe unless DST starts inside SRC. */
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  dst += size;
+  src += size;
+  if (size >= BLOCK_OP_MIN) 
     {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      /* Copy downward: bytes down to a word boundary in DST, then
+         words.  The direction flag must be clear again on exit. */
+      size_t tail = (uintptr_t) dst % sizeof (word_t);
+      size_t words;
+
+      size -= tail;
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      dst--;
+      src--;
+      asm volatile ("std\n\t"
+                    "rep movsb\n\t"
+                    "subl $3, %%edi\n\t"
+                    "subl $3, %%esi\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep movsl\n\t"
+                    "cld"
+                    : "+D" (dst), "+S" (src), "+c" (tail)
+                    : "r" (words)
+                    : "memory");
+      dst += sizeof (word_t);
+      src += sizeof (word_t);
     }
+  while (size-- > 0)
+    *--dst = *--src;
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +109,14 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= sizeof (word_t); size -= sizeof (word_t))
+    {
+      if (*(const word_t *) a != *(const word_t *) b)
+        break;
+      a += sizeof (word_t);
+      b += sizeof (word_t);
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,7 +340,24 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= BLOCK_OP_MIN) 
+    {
+      /* Store bytes up to a word boundary, then words. */
+      word_t word = (unsigned char) value * 0x01010101u;
+      size_t head = -(uintptr_t) dst % sizeof (word_t);
+      size_t words;
+
+      size -= head;
+      words = size / sizeof (word_t);
+      size %= sizeof (word_t);
+      asm volatile ("rep stosb\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep stosl"
+                    : "+D" (dst), "+c" (head)
+                    : "a" (word), "r" (words)
+                    : "memory");
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -296,8 +372,21 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  for (p = string; (uintptr_t) p % sizeof (word_t) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+
+  /* Look for a null byte a word at a time.  An aligned word never
+     spans a page boundary, so this never touches a page that the
+     string itself does not reach. */
+  for (;; p += sizeof (word_t)) 
+    {
+      word_t w = *(const word_t *) p;
+      if ((w - 0x01010101u) & ~w & 0x80808080u)
+        break;
+    }
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
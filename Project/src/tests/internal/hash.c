@@ -0,0 +1,233 @@
+/* Test program and benchmark for lib/kernel/hash.c.
+
+   Checks the open-addressing hash table against the chained one
+   under a random mix of insertions, lookups and deletions, then
+   times both for insertion, successful and failed lookups, and
+   deletion at a range of table sizes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Maximum number of elements in a table that we will test. */
+#define MAX_SIZE 16384
+
+/* Number of operations in the randomized test. */
+#define TEST_OPS 100000
+
+/* A hash table element, which can be in one table of each
+   kind at once. */
+struct value
+  {
+    struct hash_elem elem;      /* Element in chained table. */
+    struct hash_elem oelem;     /* Element in open-addressing table. */
+    int value;                  /* Item value. */
+  };
+
+static struct value values[MAX_SIZE];
+
+static unsigned value_hash (const struct hash_elem *, void *);
+static bool value_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static unsigned ovalue_hash (const struct hash_elem *, void *);
+static bool ovalue_less (const struct hash_elem *, const struct hash_elem *,
+                         void *);
+static void test_correctness (void);
+static void bench (size_t size);
+
+/* Tests and times the hash tables. */
+void
+test (void)
+{
+  size_t size;
+
+  test_correctness ();
+  printf ("hash: PASS\n");
+
+  printf ("microseconds for SIZE operations, chained vs. open addressing:\n");
+  for (size = 64; size <= MAX_SIZE; size *= 4)
+    bench (size);
+}
+
+/* Performs a random mix of operations on both kinds of table,
+   checking that they always agree. */
+static void
+test_correctness (void)
+{
+  struct hash h;
+  struct ohash o;
+  static bool in[MAX_SIZE / 4];
+  int i;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  ASSERT (ohash_init (&o, ovalue_hash, ovalue_less, NULL));
+
+  /* Make several elements with each value, so that insertions
+     of equal elements are tried as well. */
+  for (i = 0; i < MAX_SIZE; i++)
+    values[i].value = i % (MAX_SIZE / 4);
+  for (i = 0; i < MAX_SIZE / 4; i++)
+    in[i] = false;
+
+  for (i = 0; i < TEST_OPS; i++)
+    {
+      struct value *v = &values[random_ulong () % MAX_SIZE];
+      struct value key;
+      struct hash_elem *e, *oe;
+
+      key.value = v->value;
+      switch (random_ulong () % 3)
+        {
+        case 0:
+          e = hash_insert (&h, &v->elem);
+          oe = ohash_insert (&o, &v->oelem);
+          ASSERT ((e == NULL) == !in[v->value]);
+          ASSERT ((oe == NULL) == !in[v->value]);
+          ASSERT (oe == NULL
+                  || hash_entry (oe, struct value, oelem)->value == v->value);
+          in[v->value] = true;
+          break;
+
+        case 1:
+          e = hash_find (&h, &key.elem);
+          oe = ohash_find (&o, &key.oelem);
+          ASSERT ((e != NULL) == in[v->value]);
+          ASSERT ((oe != NULL) == in[v->value]);
+          ASSERT (oe == NULL
+                  || hash_entry (oe, struct value, oelem)->value == v->value);
+          break;
+
+        case 2:
+          e = hash_delete (&h, &key.elem);
+          oe = ohash_delete (&o, &key.oelem);
+          ASSERT ((e != NULL) == in[v->value]);
+          ASSERT ((oe != NULL) == in[v->value]);
+          in[v->value] = false;
+          break;
+        }
+      ASSERT (hash_size (&h) == ohash_size (&o));
+    }
+
+  hash_destroy (&h, NULL);
+  ohash_destroy (&o, NULL);
+}
+
+/* Prints the time each kind of table takes to insert SIZE
+   elements, look each of them up, look up SIZE missing
+   elements, and delete each element. */
+static void
+bench (size_t size)
+{
+  struct hash h;
+  struct ohash o;
+  int64_t start, insert[2], find[2], miss[2], delete[2];
+  struct value key;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    values[i].value = i;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    hash_insert (&h, &values[i].elem);
+  insert[0] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = i;
+      ASSERT (hash_find (&h, &key.elem) != NULL);
+    }
+  find[0] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = size + i;
+      ASSERT (hash_find (&h, &key.elem) == NULL);
+    }
+  miss[0] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = i;
+      ASSERT (hash_delete (&h, &key.elem) != NULL);
+    }
+  delete[0] = timer_usecs () - start;
+  hash_destroy (&h, NULL);
+
+  ASSERT (ohash_init (&o, ovalue_hash, ovalue_less, NULL));
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    ohash_insert (&o, &values[i].oelem);
+  insert[1] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = i;
+      ASSERT (ohash_find (&o, &key.oelem) != NULL);
+    }
+  find[1] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = size + i;
+      ASSERT (ohash_find (&o, &key.oelem) == NULL);
+    }
+  miss[1] = timer_usecs () - start;
+  start = timer_usecs ();
+  for (i = 0; i < size; i++)
+    {
+      key.value = i;
+      ASSERT (ohash_delete (&o, &key.oelem) != NULL);
+    }
+  delete[1] = timer_usecs () - start;
+  ohash_destroy (&o, NULL);
+
+  printf ("%5zu: insert %"PRId64"/%"PRId64", find %"PRId64"/%"PRId64
+          ", miss %"PRId64"/%"PRId64", delete %"PRId64"/%"PRId64"\n",
+          size, insert[0], insert[1], find[0], find[1],
+          miss[0], miss[1], delete[0], delete[1]);
+}
+
+/* Returns a hash value for the value in ELEM. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, elem)->value);
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, elem)->value
+          < hash_entry (b, struct value, elem)->value);
+}
+
+/* Returns a hash value for the value in OELEM. */
+static unsigned
+ovalue_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, oelem)->value);
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+ovalue_less (const struct hash_elem *a, const struct hash_elem *b,
+             void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, oelem)->value
+          < hash_entry (b, struct value, oelem)->value);
+}
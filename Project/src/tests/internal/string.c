@@ -0,0 +1,269 @@
+/* Test program and micro-benchmark for the block functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp() and strlen()
+   against simple byte-at-a-time versions for many sizes and
+   alignments, then prints the throughput of each, and of its
+   byte-at-a-time counterpart, for a range of block sizes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest block that we will test or time. */
+#define MAX_SIZE 16384
+
+/* Number of bytes to process for each timing. */
+#define BENCH_BYTES (4 * 1024 * 1024)
+
+/* Buffers, with room for misalignment and overlap. */
+static unsigned char buf_a[MAX_SIZE + 64];
+static unsigned char buf_b[MAX_SIZE + 64];
+static unsigned char buf_c[MAX_SIZE + 64];
+
+/* Results of timed calls, kept so that the compiler cannot
+   discard calls to functions without side effects. */
+static volatile size_t sink;
+
+static void test_correctness (void);
+static void bench (const char *name,
+                   void (*fast) (size_t), void (*slow) (size_t));
+
+/* Byte-at-a-time versions, for reference. */
+
+static void
+slow_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+static void
+slow_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+static int
+slow_memcmp (const void *a_, const void *b_, size_t size)
+{
+  const unsigned char *a = a_;
+  const unsigned char *b = b_;
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+static size_t
+slow_strlen (const char *string)
+{
+  const char *p;
+
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
+
+/* Benchmark bodies: each processes SIZE bytes once. */
+
+static void
+fast_memcpy_op (size_t size)
+{
+  memcpy (buf_a, buf_b, size);
+}
+
+static void
+slow_memcpy_op (size_t size)
+{
+  slow_memcpy (buf_a, buf_b, size);
+}
+
+static void
+fast_memmove_op (size_t size)
+{
+  memmove (buf_a + 8, buf_a, size);
+}
+
+static void
+fast_memset_op (size_t size)
+{
+  memset (buf_a, 0, size);
+}
+
+static void
+slow_memset_op (size_t size)
+{
+  slow_memset (buf_a, 0, size);
+}
+
+static void
+fast_memcmp_op (size_t size)
+{
+  sink = memcmp (buf_a, buf_c, size);
+}
+
+static void
+slow_memcmp_op (size_t size)
+{
+  sink = slow_memcmp (buf_a, buf_c, size);
+}
+
+static void
+fast_strlen_op (size_t size UNUSED)
+{
+  sink = strlen ((char *) buf_b);
+}
+
+static void
+slow_strlen_op (size_t size UNUSED)
+{
+  sink = slow_strlen ((char *) buf_b);
+}
+
+/* Tests and times the string functions. */
+void
+test (void)
+{
+  test_correctness ();
+  printf ("string: PASS\n");
+
+  printf ("throughput in MB/s, optimized vs. byte at a time:\n");
+  bench ("memcpy", fast_memcpy_op, slow_memcpy_op);
+  bench ("memmove", fast_memmove_op, slow_memcpy_op);
+  bench ("memset", fast_memset_op, slow_memset_op);
+  bench ("memcmp", fast_memcmp_op, slow_memcmp_op);
+  bench ("strlen", fast_strlen_op, slow_strlen_op);
+}
+
+/* Fills BUF with SIZE random bytes, none of them zero. */
+static void
+randomize (unsigned char *buf, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = random_ulong () % 255 + 1;
+}
+
+/* Checks the functions at every alignment for a range of
+   sizes. */
+static void
+test_correctness (void)
+{
+  size_t size;
+
+  printf ("testing various sizes:");
+  for (size = 0; size <= MAX_SIZE; size = size < 64 ? size + 1 : size * 2)
+    {
+      size_t a_ofs, b_ofs;
+
+      printf (" %zu", size);
+      for (a_ofs = 0; a_ofs < 8; a_ofs++)
+        for (b_ofs = 0; b_ofs < 8; b_ofs++)
+          {
+            unsigned char *a = buf_a + a_ofs;
+            unsigned char *b = buf_b + b_ofs;
+            size_t i;
+
+            /* memcpy(), checking that nothing outside is touched. */
+            randomize (buf_a, sizeof buf_a);
+            randomize (buf_b, sizeof buf_b);
+            memcpy (buf_c, buf_a, sizeof buf_a);
+            ASSERT (memcpy (a, b, size) == a);
+            slow_memcpy (buf_c + a_ofs, b, size);
+            ASSERT (!slow_memcmp (buf_a, buf_c, sizeof buf_a));
+
+            /* memcmp(), equal and with one byte changed. */
+            ASSERT (memcmp (a, b, size) == 0);
+            if (size > 0)
+              {
+                i = random_ulong () % size;
+                b[i] ^= random_ulong () % 255 + 1;
+                ASSERT (memcmp (a, b, size) == slow_memcmp (a, b, size));
+                ASSERT (memcmp (b, a, size) == slow_memcmp (b, a, size));
+              }
+
+            /* memset(). */
+            memcpy (buf_c, buf_a, sizeof buf_a);
+            ASSERT (memset (a, b_ofs, size) == a);
+            slow_memset (buf_c + a_ofs, b_ofs, size);
+            ASSERT (!memcmp (buf_a, buf_c, sizeof buf_a));
+
+            /* memmove(), both directions, overlapping. */
+            randomize (buf_a, sizeof buf_a);
+            memcpy (buf_c, buf_a, sizeof buf_a);
+            ASSERT (memmove (buf_a + a_ofs, buf_a + b_ofs + 8, size)
+                    == buf_a + a_ofs);
+            memcpy (buf_b, buf_c + b_ofs + 8, size);
+            memcpy (buf_c + a_ofs, buf_b, size);
+            ASSERT (!memcmp (buf_a, buf_c, sizeof buf_a));
+            memcpy (buf_c, buf_a, sizeof buf_a);
+            ASSERT (memmove (buf_a + b_ofs + 8, buf_a + a_ofs, size)
+                    == buf_a + b_ofs + 8);
+            memcpy (buf_b, buf_c + a_ofs, size);
+            memcpy (buf_c + b_ofs + 8, buf_b, size);
+            ASSERT (!memcmp (buf_a, buf_c, sizeof buf_a));
+
+            /* strlen(). */
+            randomize (buf_a, sizeof buf_a);
+            a[size] = '\0';
+            ASSERT (strlen ((char *) a) == size);
+          }
+    }
+  printf (" done\n");
+}
+
+/* Returns the throughput, in MB/s, of running OP on blocks of
+   SIZE bytes. */
+static int64_t
+throughput (void (*op) (size_t), size_t size)
+{
+  size_t reps = BENCH_BYTES / size;
+  int64_t start, elapsed;
+  size_t i;
+
+  start = timer_usecs ();
+  for (i = 0; i < reps; i++)
+    op (size);
+  elapsed = timer_usecs () - start;
+  return elapsed > 0 ? (int64_t) (reps * size) / elapsed : 0;
+}
+
+/* Prints the throughput of FAST and SLOW, named NAME, for a
+   range of block sizes. */
+static void
+bench (const char *name, void (*fast) (size_t), void (*slow) (size_t))
+{
+  size_t size;
+
+  printf ("%-8s", name);
+  for (size = 16; size <= MAX_SIZE; size *= 4)
+    {
+      /* strlen() measures strings of SIZE bytes. */
+      memset (buf_a, 0x55, MAX_SIZE);
+      memset (buf_b, 0x55, MAX_SIZE);
+      memset (buf_c, 0x55, MAX_SIZE);
+      buf_b[size] = '\0';
+
+      printf (" %zu: %"PRId64"/%"PRId64, size,
+              throughput (fast, size), throughput (slow, size));
+    }
+  printf ("\n");
+}
@@ -0,0 +1,93 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point numbers, as used by the multi-level
+   feedback queue scheduler: 17 integer bits, 14 fraction bits,
+   and a sign bit, in an int.
+
+   X and Y below are fixed-point numbers, N is an integer. */
+typedef int fixed_point;
+
+#define FP_SHIFT 14                     /* Number of fraction bits. */
+#define FP_ONE (1 << FP_SHIFT)          /* 1 in fixed point. */
+
+/* Converts N to fixed point. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_point x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_point
+fp_add (fixed_point x, fixed_point y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_point
+fp_sub (fixed_point x, fixed_point y)
+{
+  return x - y;
+}
+
+/* Returns X + N. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X - N. */
+static inline fixed_point
+fp_sub_int (fixed_point x, int n)
+{
+  return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X * N. */
+static inline fixed_point
+fp_mul_int (fixed_point x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+/* Returns X / N. */
+static inline fixed_point
+fp_div_int (fixed_point x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
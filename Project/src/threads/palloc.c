@@ -1,12 +1,13 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,14 +24,66 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**ORDER pages, aligned to their size within the
+   pool, on one free list per order.  A request is served from
+   the smallest block big enough for it, splitting larger blocks
+   as needed, and the unused tail of the block is freed again at
+   once.  A freed range is broken into aligned blocks, each of
+   which is merged with its "buddy", the other half of the block
+   of the next larger order, for as long as the buddy is free.
+   Allocating and freeing thus take time proportional to the
+   number of orders, not to the size of the pool.
+
+   That bound lets each pool be protected by disabling interrupts
+   rather than by a lock.  Pages must be freed without sleeping
+   from places that cannot block, such as thread_schedule_tail(),
+   which frees a dying thread's page in the middle of a context
+   switch, possibly on the idle thread.
+
+   The list element of a free block lives in its first page.  A
+   byte per page, at the base of the pool, records which pages
+   are allocated and which begin free blocks.
+
+   The idle thread also keeps a few pages of each pool zeroed in
+   advance, by calling palloc_prezero(), so that most PAL_ZERO
+   requests for a single page need no memset().  Those pages
+   count as allocated; they go back to the free lists as soon as
+   a request cannot otherwise be met. */
+
+/* Largest order of a free block. */
+#define MAX_ORDER 15
+
+/* Number of pre-zeroed pages kept in each pool. */
+#define ZERO_PAGES 32
+
+/* Page states, one byte per page.  A page that is free but does
+   not begin a free block is 0. */
+#define PAGE_USED 0x80                  /* Allocated. */
+#define PAGE_FREE 0x40                  /* Begins a free block... */
+#define PAGE_ORDER_MASK 0x3f            /* ...whose order is here. */
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
+    uint8_t *state;                     /* State of each page. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    struct list free[MAX_ORDER + 1];    /* Free blocks, by order. */
+
+    /* Pre-zeroed pages. */
+    void *zero_pages[ZERO_PAGES];       /* Zeroed pages. */
+    size_t zero_cnt;                    /* Number of zeroed pages. */
+
+    /* Statistics. */
+    size_t free_cnt;                    /* Number of free pages. */
+    size_t block_cnt[MAX_ORDER + 1];    /* Number of free blocks. */
+    size_t fail_cnt;                    /* Number of failed requests. */
+    size_t zero_hit_cnt;                /* PAL_ZERO pages pre-zeroed. */
+    size_t zero_miss_cnt;               /* PAL_ZERO pages memset(). */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +92,10 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zero_page (struct pool *);
+static bool release_zero_pages (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,17 +128,29 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if ((flags & PAL_ZERO) && page_cnt == 1)
+    {
+      pages = take_zero_page (pool);
+      if (pages != NULL)
+        return pages;
+    }
 
-  if (page_idx != BITMAP_ERROR)
+  old_level = intr_disable ();
+  page_idx = pool_alloc (pool, page_cnt);
+  if (page_idx == SIZE_MAX && release_zero_pages (pool))
+    page_idx = pool_alloc (pool, page_cnt);
+  if (page_idx != SIZE_MAX && (flags & PAL_ZERO) && page_cnt == 1)
+    pool->zero_miss_cnt++;
+  intr_set_level (old_level);
+
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -113,12 +182,15 @@ palloc_get_page (enum palloc_flags flags)
   return palloc_get_multiple (flags, 1);
 }
 
-/* Frees the PAGE_CNT pages starting at PAGES. */
+/* Frees the PAGE_CNT pages starting at PAGES.  Never sleeps, so
+   it may be called with interrupts off. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
+  size_t i;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +209,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  for (i = 0; i < page_cnt; i++)
+    ASSERT (pool->state[page_idx + i] == PAGE_USED);
+  pool_free (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +223,120 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page for a later PAL_ZERO request, if any pool
+   is short of pre-zeroed pages and has pages to spare.  Returns
+   true if it zeroed a page, false if there was nothing to do.
+   Called by the idle thread. */
+bool
+palloc_prezero (void) 
+{
+  struct pool *pools[] = { &user_pool, &kernel_pool };
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *p = pools[i];
+      enum intr_level old_level;
+      size_t page_idx = SIZE_MAX;
+      void *page;
+
+      old_level = intr_disable ();
+      /* Leave the last few pages to ordinary requests. */
+      if (p->zero_cnt < ZERO_PAGES && p->free_cnt > ZERO_PAGES)
+        page_idx = pool_alloc (p, 1);
+      intr_set_level (old_level);
+      if (page_idx == SIZE_MAX)
+        continue;
+
+      page = p->base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      /* Only the idle thread adds pages, so there is still room. */
+      old_level = intr_disable ();
+      ASSERT (p->zero_cnt < ZERO_PAGES);
+      p->zero_pages[p->zero_cnt++] = page;
+      intr_set_level (old_level);
+      return true;
+    }
+  return false;
+}
+
+/* Prints statistics for one pool. */
+static void
+print_pool_stats (struct pool *p)
+{
+  struct pool s;
+  enum intr_level old_level;
+  int largest = -1;
+  int order;
+
+  /* Take a consistent snapshot, since printing may sleep. */
+  old_level = intr_disable ();
+  s = *p;
+  intr_set_level (old_level);
+  p = &s;
+
+  for (order = MAX_ORDER; order >= 0; order--)
+    if (p->block_cnt[order] > 0)
+      {
+        largest = order;
+        break;
+      }
+  printf ("Palloc %s: %zu of %zu pages free, largest block %zu pages, "
+          "%zu failures\n", p->name, p->free_cnt, p->page_cnt,
+          largest >= 0 ? (size_t) 1 << largest : 0, p->fail_cnt);
+  printf ("  %zu pages pre-zeroed, %zu PAL_ZERO hits, %zu misses\n",
+          p->zero_cnt, p->zero_hit_cnt, p->zero_miss_cnt);
+  if (largest >= 0)
+    {
+      printf ("  free blocks by order:");
+      for (order = 0; order <= largest; order++)
+        printf (" %zu", p->block_cnt[order]);
+      printf ("\n");
+    }
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page states at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t state_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+
+  if (state_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page states.", name);
+  page_cnt -= state_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->state = base;
+  p->base = base + state_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  for (order = 0; order <= MAX_ORDER; order++)
+    {
+      list_init (&p->free[order]);
+      p->block_cnt[order] = 0;
+    }
+  p->zero_cnt = 0;
+  p->free_cnt = 0;
+  p->fail_cnt = 0;
+  p->zero_hit_cnt = 0;
+  p->zero_miss_cnt = 0;
+  pool_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +346,155 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the list element kept in page PAGE_IDX of P. */
+static struct list_elem *
+page_elem (struct pool *p, size_t page_idx)
+{
+  return (struct list_elem *) (p->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in P of the page that holds list element E. */
+static size_t
+elem_page (struct pool *p, struct list_elem *e)
+{
+  return pg_no (e) - pg_no (p->base);
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX in P on its
+   free list, without merging it with its buddy. */
+static void
+push_block (struct pool *p, size_t page_idx, int order)
+{
+  p->state[page_idx] = PAGE_FREE | order;
+  list_push_front (&p->free[order], page_elem (p, page_idx));
+  p->block_cnt[order]++;
+}
+
+/* Takes the free block of 2**ORDER pages at PAGE_IDX in P off
+   its free list. */
+static void
+pop_block (struct pool *p, size_t page_idx, int order)
+{
+  ASSERT (p->state[page_idx] == (PAGE_FREE | order));
+  p->state[page_idx] = 0;
+  list_remove (page_elem (p, page_idx));
+  p->block_cnt[order]--;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in P, merging it
+   with its buddy for as long as the buddy is free too. */
+static void
+free_block (struct pool *p, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t size = (size_t) 1 << order;
+      size_t buddy = page_idx ^ size;
+      if (buddy + size > p->page_cnt
+          || p->state[buddy] != (PAGE_FREE | order))
+        break;
+      pop_block (p, buddy, order);
+      page_idx &= ~size;
+      order++;
+    }
+  push_block (p, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in P, as the
+   largest aligned blocks that cover them. */
+static void
+pool_free (struct pool *p, size_t page_idx, size_t page_cnt)
+{
+  memset (p->state + page_idx, 0, page_cnt);
+  p->free_cnt += page_cnt;
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (p, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from P and returns the
+   index of the first, or SIZE_MAX if no block is big enough. */
+static size_t
+pool_alloc (struct pool *p, size_t page_cnt)
+{
+  size_t page_idx;
+  int order, i;
+
+  /* Find the smallest free block that is big enough. */
+  for (order = 0; ((size_t) 1 << order) < page_cnt; order++)
+    if (order == MAX_ORDER)
+      {
+        p->fail_cnt++;
+        return SIZE_MAX;
+      }
+  for (i = order; list_empty (&p->free[i]); i++)
+    if (i == MAX_ORDER)
+      {
+        p->fail_cnt++;
+        return SIZE_MAX;
+      }
+  page_idx = elem_page (p, list_front (&p->free[i]));
+  pop_block (p, page_idx, i);
+
+  /* Split it down to the size we need, keeping the lower half. */
+  while (i > order)
+    {
+      i--;
+      push_block (p, page_idx + ((size_t) 1 << i), i);
+    }
+  memset (p->state + page_idx, PAGE_USED, page_cnt);
+  p->free_cnt -= (size_t) 1 << order;
+
+  /* Give back the tail we do not need. */
+  if (((size_t) 1 << order) > page_cnt)
+    pool_free (p, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+  return page_idx;
+}
+
+/* Takes a pre-zeroed page from P and returns it, or returns a
+   null pointer if there is none. */
+static void *
+take_zero_page (struct pool *p)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (p->zero_cnt > 0)
+    {
+      page = p->zero_pages[--p->zero_cnt];
+      p->zero_hit_cnt++;
+    }
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Returns P's pre-zeroed pages to its free lists.  Interrupts
+   must be off.  Returns true if there were any. */
+static bool
+release_zero_pages (struct pool *p)
+{
+  bool released = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  while (p->zero_cnt > 0)
+    {
+      void *page = p->zero_pages[--p->zero_cnt];
+      pool_free (p, pg_no (page) - pg_no (p->base), 1);
+      released = true;
+    }
+  return released;
+}
@@ -0,0 +1,221 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* An object cache allocator.
+
+   malloc() rounds every request up to a power of 2, so a
+   structure a little bigger than one wastes almost half of its
+   block.  A slab cache instead serves objects of a single type,
+   at their exact size.
+
+   Each cache carves pages, called "slabs", into as many objects
+   as fit after a small header.  The header links the free
+   objects by index, so the free objects themselves are never
+   written.  That lets a cache have a constructor: it runs once
+   for each object, when its slab is created, and the object
+   keeps whatever state the constructor gave it for as long as
+   the slab lives.  Users of a cache with a constructor must free
+   objects in their constructed state.
+
+   A cache keeps at most one slab with no objects in use, to
+   avoid handing a page back and forth to the page allocator
+   when an object is allocated and freed repeatedly. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Alignment of objects. */
+#define SLAB_ALIGN 8
+
+/* Index that ends a free list. */
+#define SLAB_NONE UINT16_MAX
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's slabs, if not full. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free;              /* Index of first free object. */
+    uint16_t next[];            /* NEXT[I] follows object I on free list. */
+  };
+
+/* All caches, for slab_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+/* Returns the offset of the first object in a slab that holds
+   OBJ_CNT objects. */
+static size_t
+objs_offset (size_t obj_cnt)
+{
+  return ROUND_UP (sizeof (struct slab) + obj_cnt * sizeof (uint16_t),
+                   SLAB_ALIGN);
+}
+
+/* Returns the address of object IDX in slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx)
+{
+  struct slab_cache *c = s->cache;
+  return (uint8_t *) s + objs_offset (c->objs_per_slab) + idx * c->obj_size;
+}
+
+/* Initializes C as a cache of objects of SIZE bytes, named NAME.
+   If CTOR is non-null, it is called on each object before it is
+   first allocated. */
+void
+slab_cache_init (struct slab_cache *c, const char *name, size_t size,
+                 slab_ctor_func *ctor)
+{
+  enum intr_level old_level;
+  size_t n;
+
+  ASSERT (c != NULL && name != NULL);
+  ASSERT (size > 0);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, SLAB_ALIGN);
+  n = (PGSIZE - sizeof (struct slab)) / (c->obj_size + sizeof (uint16_t));
+  while (n > 0 && objs_offset (n) + n * c->obj_size > PGSIZE)
+    n--;
+  ASSERT (n > 0 && n < SLAB_NONE);
+  c->objs_per_slab = n;
+  c->ctor = ctor;
+  list_init (&c->slabs);
+  c->empty_cnt = 0;
+  lock_init (&c->lock);
+  c->slab_cnt = 0;
+  c->in_use = 0;
+  c->alloc_cnt = 0;
+  c->free_cnt = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&all_caches, &c->elem);
+  intr_set_level (old_level);
+}
+
+/* Creates a new slab for C, runs the constructor on its objects,
+   and adds it to C's slabs.  Returns false if no page is
+   available.  C's lock must be held. */
+static bool
+slab_grow (struct slab_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return false;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free = 0;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      s->next[i] = i + 1 < c->objs_per_slab ? i + 1 : SLAB_NONE;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (s, i));
+    }
+  list_push_front (&c->slabs, &s->elem);
+  c->slab_cnt++;
+  c->empty_cnt++;
+  return true;
+}
+
+/* Allocates and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->slabs) && !slab_grow (c))
+    {
+      lock_release (&c->lock);
+      return NULL;
+    }
+
+  /* Partly used slabs are at the front. */
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  obj = slab_obj (s, s->free);
+  s->free = s->next[s->free];
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+  c->in_use++;
+  c->alloc_cnt++;
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from slab_alloc(),
+   to its cache.  A null OBJ is ignored. */
+void
+slab_free (void *obj)
+{
+  struct slab *s;
+  struct slab_cache *c;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  c = s->cache;
+  idx = ((uint8_t *) obj - (uint8_t *) slab_obj (s, 0)) / c->obj_size;
+  ASSERT (idx < c->objs_per_slab && slab_obj (s, idx) == obj);
+
+  lock_acquire (&c->lock);
+  s->next[idx] = s->free;
+  s->free = idx;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->slabs, &s->elem);
+  c->in_use--;
+  c->free_cnt++;
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      /* Keep one empty slab around, and give the rest back.
+         Move it to the back so that allocations come from partly
+         used slabs first. */
+      list_remove (&s->elem);
+      if (c->empty_cnt > 0)
+        {
+          c->slab_cnt--;
+          s->magic = 0;
+          palloc_free_page (s);
+        }
+      else
+        {
+          list_push_back (&c->slabs, &s->elem);
+          c->empty_cnt++;
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+slab_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+      printf ("Slab %s: %zu-byte objects, %zu in use, %zu slabs of %zu, "
+              "%llu allocs, %llu frees\n",
+              c->name, c->obj_size, c->in_use, c->slab_cnt,
+              c->objs_per_slab, c->alloc_cnt, c->free_cnt);
+    }
+}
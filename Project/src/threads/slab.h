@@ -0,0 +1,37 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Prepares a newly created object OBJ for its first use. */
+typedef void slab_ctor_func (void *obj);
+
+/* A cache of objects of one type.  See slab.c for details. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object, rounded up. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    slab_ctor_func *ctor;       /* Constructor, or a null pointer. */
+    struct list slabs;          /* Slabs with at least one free object. */
+    size_t empty_cnt;           /* Number of those that are all free. */
+    struct lock lock;           /* Protects all of the above and below. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t in_use;              /* Number of objects allocated. */
+    unsigned long long alloc_cnt; /* Number of slab_alloc() calls. */
+    unsigned long long free_cnt;  /* Number of slab_free() calls. */
+
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      slab_ctor_func *);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -4,6 +4,8 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -23,9 +25,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one queue per
+   priority.  Bit P of READY_MASK is set if and only if
+   READY_QUEUES[P] is nonempty, so the highest priority ready
+   thread is found without scanning. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* # of threads in READY_QUEUES. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -37,8 +44,13 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Number of dead threads' pages kept for reuse. */
+#define SPARE_THREAD_CNT 8
+
+/* Pages of dead threads, which thread_create() reuses before
+   asking the page allocator.  Access with interrupts off. */
+static struct thread *spare_threads[SPARE_THREAD_CNT];
+static size_t spare_thread_cnt;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -62,6 +74,10 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define PRI_INTERVAL 4          /* # of timer ticks between priority updates. */
+static fixed_point load_avg;    /* Average # of threads ready to run. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -71,6 +87,11 @@ static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static int ready_max_priority (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 
@@ -79,7 +100,7 @@ static tid_t allocate_tid (void);
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queue.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -90,10 +111,15 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int p;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (p = PRI_MIN; p <= PRI_MAX; p++)
+    list_init (&ready_queues[p]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -137,11 +163,24 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Counts TICKS timer ticks that passed without a timer interrupt
+   while the idle thread waited in tickless mode.  Interrupts must
+   be off. */
+void
+thread_idle_ticks (int64_t ticks)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  idle_ticks += ticks;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -162,9 +201,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it runs right away. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -173,12 +211,18 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread.  Only struct thread needs clearing, and
+     init_thread() does that. */
+  old_level = intr_disable ();
+  t = spare_thread_cnt > 0 ? spare_threads[--spare_thread_cnt] : NULL;
+  intr_set_level (old_level);
+  if (t == NULL)
+    t = palloc_get_page (0);
   if (t == NULL)
     return TID_ERROR;
 
@@ -212,6 +256,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -239,7 +284,9 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward to let T
+   run if it has a higher priority.  In an interrupt handler,
+   that happens on return from the interrupt anyway. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -249,8 +296,28 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
+  if (intr_context () && t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than the
+   running thread.  In an interrupt handler, yields on return from
+   the interrupt instead. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (ready_max_priority () > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
   intr_set_level (old_level);
 }
 
@@ -322,7 +389,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -345,11 +412,79 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields if it no longer has the highest priority.  Priority
+   donated to the thread still applies.  Has no effect under the
+   multi-level feedback queue scheduler, which sets priorities
+   itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_refresh_priority ();
+  thread_preempt ();
+  intr_set_level (old_level);
+}
+
+/* Sets T's priority, including donations, to PRIORITY, moving T
+   to the matching ready queue if it is ready.  Does not yield.
+   Interrupts must be off. */
+void
+thread_set_effective_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->status == THREAD_READY && t != idle_thread)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes the running thread's priority as the highest of its
+   base priority and the priorities of the threads waiting for
+   the locks it holds.  Does not yield.  Interrupts must be
+   off.  There is no donation under the multi-level feedback
+   queue scheduler, so then this does nothing. */
+void
+thread_refresh_priority (void)
+{
+  struct thread *cur = thread_current ();
+  int priority = cur->base_priority;
+  struct list_elem *e, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (e = list_begin (&cur->locks); e != list_end (&cur->locks);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock,
+                                          elem)->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *t = list_entry (w, struct thread, elem);
+          if (t->priority > priority)
+            priority = t->priority;
+        }
+    }
+  cur->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -359,35 +494,120 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    {
+      cur->priority = mlfqs_priority (cur);
+      thread_preempt ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
+}
+
+/* Returns T's priority under the multi-level feedback queue
+   scheduler: PRI_MAX - recent_cpu / 4 - nice * 2, clamped to the
+   valid range. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  fixed_point p = fp_sub (fp_from_int (PRI_MAX - t->nice * 2),
+                          fp_div_int (t->recent_cpu, 4));
+  int priority = fp_trunc (p);
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Decays T's recent_cpu by the load average and recomputes its
+   priority.  Called once per second for every thread, with
+   interrupts off. */
+static void
+mlfqs_update (struct thread *t, void *coefficient_)
+{
+  fixed_point *coefficient = coefficient_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coefficient, t->recent_cpu),
+                              t->nice);
+  thread_set_effective_priority (t, mlfqs_priority (t));
+}
+
+/* Multi-level feedback queue scheduler work for a timer tick
+   during which CUR was running.
+
+   Only the running thread's recent_cpu changes from tick to tick,
+   so only its priority is recomputed every PRI_INTERVAL ticks.
+   The load average, and with it every thread's recent_cpu and
+   priority, is updated once per second. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready = ready_cnt + (cur != idle_thread);
+      fixed_point coefficient;
+
+      load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                         fp_div_int (fp_from_int (ready), 60));
+      coefficient = fp_div (fp_mul_int (load_avg, 2),
+                            fp_add_int (fp_mul_int (load_avg, 2), 1));
+      thread_foreach (mlfqs_update, &coefficient);
+    }
+  else if (ticks % PRI_INTERVAL == 0 && cur != idle_thread)
+    cur->priority = mlfqs_priority (cur);
+  else
+    return;
+
+  if (ready_max_priority () > cur->priority)
+    intr_yield_on_return ();
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -404,6 +624,7 @@ idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
   idle_thread = thread_current ();
+  idle_thread->priority = PRI_MIN;      /* Even if the MLFQS set it. */
   sema_up (idle_started);
 
   for (;;) 
@@ -412,6 +633,20 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Meanwhile, zero pages for PAL_ZERO requests.  A thread
+         that outranks us preempts us; one that does not is seen
+         here. */
+      intr_enable ();
+      while (ready_cnt == 0 && palloc_prezero ())
+        continue;
+      intr_disable ();
+      if (ready_cnt > 0)
+        continue;
+
+      /* Nothing is ready to run, so don't take timer interrupts
+         until some thread is due to wake up. */
+      timer_tickless_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -475,37 +710,44 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
+  if (thread_mlfqs && t != initial_thread)
+    {
+      /* Inherit the creator's niceness and CPU history, and let
+         them decide the priority. */
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      priority = mlfqs_priority (t);
+    }
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->locks);
+  t->waiting_lock = NULL;
   t->magic = THREAD_MAGIC;
 
-  t->sleep = false;
-  t->time_awake = 0;
+  t->wake_usecs = 0;
 
   t->cur_dir=NULL;
 
   /* Newly added. */
   #ifdef USERPROG
-  if (!strcmp (name, "main"))
-    t->parent = NULL;
-  else
-  {
-    /* Set parent and push newly created child process to parent's list.*/
-    t->parent = thread_current ();
-    list_push_back (&thread_current ()->children, &t->child_elem);
-  }
+  /* Set by start_process() for a user process. */
+  t->child_status = NULL;
   /* -1 means abnormal exit. */
   t->exit_state = -1;
-  /* Whether has been called on wait by parent. */
-  t->wait = 0;
   /* Opening file list. */
   list_init(&t->files);
   /* File descriptor, starting from 2, 0 and 1 are for console usage. */
   t->fd=2;
   /* List of its children process. */
   list_init (&t->children);
-  sema_init (&t->load_sema, 0);
-  sema_init (&t->wait_sema, 0);
   #endif
+#ifdef VM
+  /* Memory-mapped files. */
+  list_init (&t->mmaps);
+  t->mapid = 0;
+#endif
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
@@ -524,18 +766,62 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the ready queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from its ready queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+}
+
+/* Returns the highest priority of any ready thread, or -1 if no
+   thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  uint32_t hi = ready_mask >> 32;
+  uint32_t lo = ready_mask;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return -1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  Threads of equal priority take turns. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int p = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (p < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  queue = &ready_queues[p];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  ready_cnt--;
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << p);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -580,10 +866,31 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      /* Don't free TCB if parent process not exit. */
-      if (prev->parent == NULL)
-        palloc_free_page (prev);
+      thread_free (prev);
+    }
+}
+
+/* Frees T, a thread that has died, keeping its page for reuse by
+   thread_create() if there is room. */
+void
+thread_free (struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (t->status == THREAD_DYING);
+  ASSERT (t != initial_thread);
+
+  old_level = intr_disable ();
+  t->magic = 0;
+  if (spare_thread_cnt < SPARE_THREAD_CNT)
+    {
+      spare_threads[spare_thread_cnt++] = t;
+      t = NULL;
     }
+  intr_set_level (old_level);
+  if (t != NULL)
+    palloc_free_page (t);
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -604,6 +911,11 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Resume periodic ticks, which the idle thread may have
+     stopped. */
+  if (cur == idle_thread)
+    timer_tickless_exit ();
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
@@ -614,11 +926,12 @@ static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  old_level = intr_disable ();
   tid = next_tid++;
-  lock_release (&tid_lock);
+  intr_set_level (old_level);
 
   return tid;
 }
@@ -626,15 +939,3 @@ allocate_tid (void)
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
-
-/* Newly added. */
-/* Wake the thread if sleep enougn time*/
-void
-thread_waking (struct thread *t,int64_t* ticks)
-{
-  if ( t->sleep && t->time_awake <= *ticks)
-  {
-    thread_unblock(t);
-    t->sleep = false;
-  }
-}
@@ -2,9 +2,11 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "synch.h"
+#include "threads/fixed-point.h"
 #include "filesys/directory.h"
 
 /* States in a thread's life cycle. */
@@ -26,6 +28,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Most generous. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least generous. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -89,15 +96,23 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
+    /* Priority donation. */
+    int base_priority;                  /* Priority without donations. */
+    struct list locks;                  /* Locks held. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+
+    /* Multi-level feedback queue scheduler. */
+    int nice;                           /* Niceness. */
+    fixed_point recent_cpu;             /* Recent CPU time received. */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
     /* Alarm clock. */
-    bool sleep;                         /* True if thread is sleeping. */
-    int64_t  time_awake;                /* Time to awake, meaningful only if sleep. */
+    int64_t wake_usecs;                 /* Time to wake up, if sleeping. */
 
     /* Project4 */
     struct dir* cur_dir;                /* Current directory. */
@@ -107,14 +122,17 @@ struct thread
     int fd;                             /*fd used when open files. */
     struct list files;                  /*Owned files by thread. */ 
     uint32_t *pagedir;                  /* Page directory. */
-    struct thread *parent;              /* Parent process. */
-    struct list children;               /* List of all children process. */
-    struct list_elem child_elem;        /* Owned by list children. */
-    struct semaphore load_sema;         /* Semaphore used for EXEC syscall synchronization. */
-    bool load_success;                  /* 1 if load success, 0 otherwise. */
-    struct semaphore wait_sema;         /* Semaphore used for WAIT syscall synchronization. */
+    struct list children;               /* Status of children not waited for. */
+    struct child_status *child_status;  /* Own status, shared with parent. */
     int exit_state;                     /* Exit state of the thread. */
-    bool wait;                          /* Already called on wait. */
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct ohash sup_pages;             /* Supplemental page table. */
+    struct file *exec_file;             /* Executable backing lazily loaded pages. */
+    struct list mmaps;                  /* Memory-mapped files. */
+    int mapid;                          /* Next mapping id. */
+    void *user_esp;                     /* User stack pointer on system call entry. */
 #endif
 
     /* Owned by thread.c. */
@@ -130,6 +148,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_ticks (int64_t);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -137,12 +156,14 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
+void thread_free (struct thread *);
 void thread_yield (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
@@ -151,13 +172,12 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_effective_priority (struct thread *, int);
+void thread_refresh_priority (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-/* Newly added. */
-void thread_waking (struct thread *, int64_t *);
-
 #endif /* threads/thread.h */
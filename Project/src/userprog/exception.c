@@ -2,8 +2,12 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/syscall.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -147,7 +151,22 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
-  /* Check whether it's user area or not. */
+
+#ifdef VM
+  /* Most faults on user addresses are just pages that have not
+     been brought in yet, stack that has not been grown yet, or
+     writes to pages shared copy-on-write.  A fault in the kernel
+     must come from a system call, so the user's stack pointer is
+     the one saved on entry to it. */
+  if (sup_page_fault (fault_addr, not_present, write,
+                      user ? f->esp : thread_current ()->user_esp))
+    return;
+#endif
+
+  /* A fault in kernel context means a system call touched a bad
+     user pointer: syscall.c range-checks user memory but leaves
+     unmapped pages to be caught here.  Treat it as the process's
+     own fault. */
   if (!user)
   {
      thread_exit_with_code(-1);
@@ -1,5 +1,6 @@
 #include "userprog/process.h"
 #include <debug.h>
+#include <hash.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
@@ -7,6 +8,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -15,20 +17,76 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* What a parent process knows about a child: whether it loaded
+   and, once it has exited, its exit status.  The record belongs
+   to both the child and the parent, and is freed when both are
+   done with it, so that the child's thread can be freed as soon
+   as it exits, and the parent can still wait for it later. */
+struct child_status
+  {
+    tid_t tid;                  /* Child's thread id. */
+    tid_t parent_tid;           /* Parent's thread id. */
+    bool loaded;                /* Whether the child loaded. */
+    int exit_status;            /* Child's exit status, once it exits. */
+    int ref_cnt;                /* 2 while child and parent hold it. */
+    struct semaphore load_sema; /* Upped once the child has loaded. */
+    struct semaphore exit_sema; /* Upped when the child exits. */
+    struct hash_elem hash_elem; /* Element in child_table. */
+    struct list_elem elem;      /* Element in parent's children list. */
+  };
+
+/* Children that their parents may still wait for, by tid. */
+static struct hash child_table;
 
+/* Protects child_table, the children lists, and reference
+   counts. */
+static struct lock child_lock;
+
+/* Cache of struct child_status. */
+static struct slab_cache child_cache;
+
+/* Arguments to start_process(). */
+struct exec_args
+  {
+    char *file_name;            /* Command line, then program name. */
+    struct child_status *cs;    /* New process's status record. */
+  };
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static hash_hash_func child_hash;
+static hash_less_func child_less;
+static void release_child (struct child_status *);
+
+/* Initializes the process module. */
+void
+process_init (void) 
+{
+  hash_init (&child_table, child_hash, child_less, NULL);
+  lock_init (&child_lock);
+  slab_cache_init (&child_cache, "child", sizeof (struct child_status),
+                   NULL);
+}
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   thread id, or TID_ERROR if the thread cannot be created or the
+   program cannot be loaded. */
 tid_t
 process_execute (const char *file_name) 
 {
+  struct thread *cur = thread_current ();
+  struct exec_args args;
+  struct child_status *cs;
   char *fn_copy;
   tid_t tid;
   /* Make a copy of FILE_NAME.
@@ -37,9 +95,11 @@ process_execute (const char *file_name)
   size_t size;
   size = strlen(file_name);
   /* Avoid overflow. */
-  if (fn_copy == NULL || size >= PGSIZE)
+  cs = slab_alloc (&child_cache);
+  if (fn_copy == NULL || size >= PGSIZE || cs == NULL)
   {
-    sema_down (&thread_current ()->load_sema);
+    palloc_free_page (fn_copy);
+    slab_free (cs);
     return TID_ERROR;
   }
     
@@ -53,23 +113,51 @@ process_execute (const char *file_name)
   /* strtok_r() will break the string, recerver it. */
   *(save_ptr - 1) = save_ptr!=fn_copy+size ? ' ':*(save_ptr-1);
   /* Create a new thread to execute FILE_NAME. */
-  struct file *file_ = filesys_open (name);
-  tid = thread_create (name, PRI_DEFAULT, start_process, fn_copy);
-  /* Wait for the child process to finish load. */
-  sema_down (&thread_current ()->load_sema);
+  cs->parent_tid = cur->tid;
+  cs->loaded = false;
+  cs->exit_status = -1;
+  cs->ref_cnt = 2;
+  sema_init (&cs->load_sema, 0);
+  sema_init (&cs->exit_sema, 0);
+  args.file_name = fn_copy;
+  args.cs = cs;
+  tid = thread_create (name, PRI_DEFAULT, start_process, &args);
   if (tid == TID_ERROR)
+  {
     palloc_free_page (fn_copy);
+    slab_free (cs);
+    return TID_ERROR;
+  }
+  /* Wait for the child process to finish load.  The file system
+     lock must not be held: load() takes it.  ARGS must stay valid
+     until then. */
+  sema_down (&cs->load_sema);
+  if (!cs->loaded)
+  {
+    release_child (cs);
+    return TID_ERROR;
+  }
+  /* Only now can the parent wait for it. */
+  cs->tid = tid;
+  lock_acquire (&child_lock);
+  hash_insert (&child_table, &cs->hash_elem);
+  list_push_back (&cur->children, &cs->elem);
+  lock_release (&child_lock);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *args_)
 {
-  char *file_name = file_name_;
+  struct exec_args *args = args_;
+  char *file_name = args->file_name;
+  struct child_status *cs = args->cs;
   struct intr_frame if_;
   bool success;
+
+  thread_current ()->child_status = cs;
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -79,10 +167,10 @@ start_process (void *file_name_)
 
   /* If load failed, quit. */
   palloc_free_page (file_name);
-  /* Save whether successfully load or not. */
-  thread_current ()->load_success = success;
-  /* Signal parent process that load finished. */
-  sema_up (&thread_current ()->parent->load_sema);
+  /* Save whether successfully load or not, and signal parent
+     process that load finished.  ARGS is gone after this. */
+  cs->loaded = success;
+  sema_up (&cs->load_sema);
   if (!success) 
     thread_exit ();
   /* Start the user process by simulating a return from an
@@ -105,33 +193,69 @@ start_process (void *file_name_)
    This function will be implemented in problem 2-2.  For now, it
    does nothing. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
   struct thread *cur = thread_current ();
-  struct list_elem *e;
-  struct thread *t;
-  /* Whether current child_tid, initially false. */
-  bool flag = false;
-  for (e = list_begin (&cur->children); e != list_end (&cur->children); e = list_next (e))
+  struct child_status key, *cs = NULL;
+  struct hash_elem *e;
+  int exit_status;
+
+  /* Look up the child, and take it out of the table, so that a
+     second wait() for it fails. */
+  key.tid = child_tid;
+  lock_acquire (&child_lock);
+  e = hash_find (&child_table, &key.hash_elem);
+  if (e != NULL)
   {
-    t = list_entry (e, struct thread, child_elem);
-    /* For every child process, check tid, and whether wait() has
-     been called once. */
-    if (t->tid == child_tid && !t->wait)
+    cs = hash_entry (e, struct child_status, hash_elem);
+    if (cs->parent_tid == cur->tid)
     {
-      /* tid valid. */
-      flag = true;
-      t->wait = 1;
-      /* Wait on the child process to exit. */
-      sema_down (&t->wait_sema);
-      break;
+      hash_delete (&child_table, &cs->hash_elem);
+      list_remove (&cs->elem);
     }
+    else
+      cs = NULL;
   }
+  lock_release (&child_lock);
   /* child_tid not valid or wait() called more than once. */
-  if (!flag)
+  if (cs == NULL)
     return -1;
-  /* Return the exit state of the child process. */
-  return t->exit_state;
+
+  /* Wait on the child process to exit, and return its exit
+     state. */
+  sema_down (&cs->exit_sema);
+  exit_status = cs->exit_status;
+  release_child (cs);
+  return exit_status;
+}
+
+/* Drops a reference to CS, freeing it if it was the last. */
+static void
+release_child (struct child_status *cs) 
+{
+  bool last;
+
+  lock_acquire (&child_lock);
+  last = --cs->ref_cnt == 0;
+  lock_release (&child_lock);
+  if (last)
+    slab_free (cs);
+}
+
+/* Returns a hash value for child status E. */
+static unsigned
+child_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct child_status, hash_elem)->tid);
+}
+
+/* Returns true if child status A's tid is less than B's. */
+static bool
+child_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct child_status, hash_elem)->tid
+          < hash_entry (b, struct child_status, hash_elem)->tid);
 }
 
 /* Free the current process's resources. */
@@ -149,32 +273,26 @@ process_exit (void)
   
   /* Exit message */
   printf ("%s: exit(%d)\n", cur->name, cur->exit_state);
-  /* Signal parent process that this child process exit. */
-  sema_up (&cur->wait_sema);
-
-  /* TCB of the child process not freed until parent exit. */
-  struct list_elem *e;
-  while (!list_empty (&cur->children))
-    {
-      e = list_pop_front (&cur->children);
-      struct thread *t;
-      t = list_entry (e, struct thread, child_elem);
-
-      enum intr_level old_level;
-      old_level = intr_disable ();
-
-      /* Free TCB for the child process if already finished */
-      if (t->status == THREAD_DYING)
-        palloc_free_page (t);
-      /* Otherwise tell him to free itself. */
-      else
-        t->parent = NULL;
-
-      intr_set_level (old_level);
-    }
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+#ifdef VM
+      /* Write back mapped files, then give back our frames and
+         swap slots, while the page directory that maps them still
+         exists. */
+      munmap_all ();
+      sup_page_table_destroy (cur);
+      if (cur->exec_file != NULL)
+        {
+          bool held = holding_l ();
+          if (!held)
+            acquire_l ();
+          file_close (cur->exec_file);
+          if (!held)
+            release_l ();
+          cur->exec_file = NULL;
+        }
+#endif
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -186,6 +304,30 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Signal parent process that this child process exit.  Only
+     now, so that our mapped files have been written back and our
+     executable is writable again by the time wait() returns. */
+  if (cur->child_status != NULL)
+    {
+      cur->child_status->exit_status = cur->exit_state;
+      sema_up (&cur->child_status->exit_sema);
+      release_child (cur->child_status);
+      cur->child_status = NULL;
+    }
+
+  /* No one will wait for our children now. */
+  lock_acquire (&child_lock);
+  while (!list_empty (&cur->children))
+    {
+      struct child_status *cs
+        = list_entry (list_pop_front (&cur->children),
+                      struct child_status, elem);
+      hash_delete (&child_table, &cs->hash_elem);
+      if (--cs->ref_cnt == 0)
+        slab_free (cs);
+    }
+  lock_release (&child_lock);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -291,11 +433,19 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  if (!sup_page_table_init (t))
+    goto done;
+#endif
 
   /* Open executable file. */
   /* Read the process name. */
   char *name;
   name = file_name + strlen (file_name) + 1;
+  /* Hold the file system lock only while reading the executable,
+     so that other processes' loads and system calls can run while
+     this one sets up its stack, or waits for its parent. */
+  acquire_l ();
   file = filesys_open(name);
   if (file == NULL) 
     {
@@ -304,9 +454,18 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
   /* Add the excutable file to the process's file list,
      and deny write to it. */
-  push_file(file);
+  if (!push_file(file))
+    goto done;
   file_deny_write(file);
-
+#ifdef VM
+  /* Pages are read in on demand, so keep a handle on the file
+     that the process cannot close. */
+  t->exec_file = file_reopen (file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+  file = t->exec_file;
+#endif
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -378,6 +537,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
           break;
         }
     }
+  release_l ();
+
   /* Set up stack. */
   if (!setup_stack (esp, file_name))
     goto done;
@@ -389,12 +550,16 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
+  if (holding_l ())
+    release_l ();
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -463,6 +628,25 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Only record where each page comes from.  The page fault
+     handler reads it in the first time it is touched. */
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!sup_page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -498,6 +682,51 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
+}
+
+/* Pushes the program name and arguments in FILE_NAME onto the
+   stack that *ESP points to, following the 80x86 calling
+   convention for main(). */
+static void
+push_arguments (void **esp, const char *file_name)
+{
+  *esp = PHYS_BASE;
+  /* At most 100 arguments. */
+  char *token, *save_ptr, *argv_addr[100];
+  int argc = 0;
+  /* Phase the arguments and push them on stack. */
+  for (token = strtok_r (file_name, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
+  {
+    *esp -= strlen(token) + 1;
+    memcpy(*esp, token, strlen(token)+1);
+    /* Keep track of the starting adress of the arguments. */
+    argv_addr[argc++] = *esp;
+  }
+  /* Align esp to 4 bytes. */
+  size_t align = (size_t)*esp % 4;
+  *esp -= align;
+  memset(*esp, 0, align);
+  /* Calling Convention. */
+  *esp -= 4;
+  memset(*esp, 0, 4);
+  int i = argc;
+  /* Push the address of the arguments on stack. */
+  while (i != 0)
+  {
+    *esp -= 4;
+    *(char **)*esp = argv_addr[--i];
+  }
+  /* Push the address of the first argument address on stack. */
+  *esp -= 4;
+  *(char ***)*esp = (char **)(*esp + 4);
+  /* Push the argument number on stack. */
+  *esp -= 4;
+  *(int *)*esp = argc;
+  /* Return address. */
+  *esp -= 4;
+  *(void **)*esp = 0;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -505,57 +734,32 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, const char *file_name) 
 {
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+#ifdef VM
+  /* The stack page is an ordinary zero-filled page, brought in
+     right away since the arguments go there. */
+  if (sup_page_alloc (upage) == NULL || !sup_page_pin (upage, true))
+    return false;
+  push_arguments (esp, file_name);
+  sup_page_unpin (upage);
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+      success = install_page (upage, kpage, true);
       if (success)
-      {
-        *esp = PHYS_BASE;
-        /* At most 100 arguments. */
-        char *token, *save_ptr, *argv_addr[100];
-        int argc = 0;
-        /* Phase the arguments and push them on stack. */
-        for (token = strtok_r (file_name, " ", &save_ptr); token != NULL;
-             token = strtok_r (NULL, " ", &save_ptr))
-        {
-          *esp -= strlen(token) + 1;
-          memcpy(*esp, token, strlen(token)+1);
-          /* Keep track of the starting adress of the arguments. */
-          argv_addr[argc++] = *esp;
-        }
-        /* Align esp to 4 bytes. */
-        size_t align = (size_t)*esp % 4;
-        *esp -= align;
-        memset(*esp, 0, align);
-        /* Calling Convention. */
-        *esp -= 4;
-        memset(*esp, 0, 4);
-        int i = argc;
-        /* Push the address of the arguments on stack. */
-        while (i != 0)
-        {
-          *esp -= 4;
-          *(char **)*esp = argv_addr[--i];
-        }
-        /* Push the address of the first argument address on stack. */
-        *esp -= 4;
-        *(char ***)*esp = (char **)(*esp + 4);
-        /* Push the argument number on stack. */
-        *esp -= 4;
-        *(int *)*esp = argc;
-        /* Return address. */
-        *esp -= 4;
-        *(void **)*esp = 0;
-      }
+        push_arguments (esp, file_name);
       else
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -575,3 +779,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
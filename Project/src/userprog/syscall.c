@@ -1,13 +1,26 @@
 #include "userprog/syscall.h"
+#include <inttypes.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/intq.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void syscall_handler(struct intr_frame *);
 static struct lock my_lock;
@@ -19,6 +32,92 @@ struct my_file_struct
   struct list_elem elem; /* Use for construct a list. */
 };
 
+#ifdef VM
+/* A memory-mapped file. */
+struct my_mmap_struct
+{
+  int mapid;             /* Mapping id. */
+  struct file *file;     /* Private handle on the mapped file. */
+  uint8_t *addr;         /* First mapped page. */
+  size_t page_cnt;       /* Number of mapped pages. */
+  struct list_elem elem; /* Element in the thread's mmaps list. */
+};
+#endif
+
+/* Caches of the above. */
+static struct slab_cache file_struct_cache;
+#ifdef VM
+static struct slab_cache mmap_struct_cache;
+#endif
+
+/* A system call implementation.  ARGS points to the argument
+   words, already copied into kernel memory.  The return value is
+   stored into the caller's eax. */
+typedef uint32_t syscall_func(const uint32_t *args);
+
+/* One entry in the system call table. */
+struct syscall
+{
+  const char *name;    /* Name, for statistics. */
+  int argc;            /* Number of argument words. */
+  syscall_func *func;  /* Implementation. */
+};
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+    sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+    sys_tell, sys_close, sys_chdir, sys_mkdir, sys_readdir, sys_isdir,
+    sys_inumber;
+#ifdef VM
+static syscall_func sys_mmap, sys_munmap;
+#endif
+
+/* System call table, indexed by system call number.  Entries
+   left null are unimplemented. */
+static const struct syscall syscall_table[] =
+    {
+        [SYS_HALT] = {"halt", 0, sys_halt},
+        [SYS_EXIT] = {"exit", 1, sys_exit},
+        [SYS_EXEC] = {"exec", 1, sys_exec},
+        [SYS_WAIT] = {"wait", 1, sys_wait},
+        [SYS_CREATE] = {"create", 2, sys_create},
+        [SYS_REMOVE] = {"remove", 1, sys_remove},
+        [SYS_OPEN] = {"open", 1, sys_open},
+        [SYS_FILESIZE] = {"filesize", 1, sys_filesize},
+        [SYS_READ] = {"read", 3, sys_read},
+        [SYS_WRITE] = {"write", 3, sys_write},
+        [SYS_SEEK] = {"seek", 2, sys_seek},
+        [SYS_TELL] = {"tell", 1, sys_tell},
+        [SYS_CLOSE] = {"close", 1, sys_close},
+#ifdef VM
+        [SYS_MMAP] = {"mmap", 2, sys_mmap},
+        [SYS_MUNMAP] = {"munmap", 1, sys_munmap},
+#endif
+        [SYS_CHDIR] = {"chdir", 1, sys_chdir},
+        [SYS_MKDIR] = {"mkdir", 1, sys_mkdir},
+        [SYS_READDIR] = {"readdir", 2, sys_readdir},
+        [SYS_ISDIR] = {"isdir", 1, sys_isdir},
+        [SYS_INUMBER] = {"inumber", 1, sys_inumber},
+};
+
+/* Largest argument count of any system call. */
+#define SYSCALL_MAX_ARGS 3
+
+/* Number of entries in syscall_table. */
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Per-system-call statistics.  The latency of a call is measured
+   from dispatch to return, so it includes any time the caller
+   spent blocked or preempted.  Calls that never return, such as
+   exit and halt or a call whose process is killed, are counted
+   apart, so that they don't skew the average. */
+struct syscall_stats
+{
+  long long started;   /* Number of calls dispatched. */
+  long long calls;     /* Number of calls that returned. */
+  int64_t usecs;       /* Cumulative latency of those, in microseconds. */
+};
+static struct syscall_stats syscall_stats[SYSCALL_CNT];
+
 static struct my_file_struct *find_file(const int fd)
 {
   /* Traverse the list and find the file with certain fd we want. */
@@ -33,50 +132,112 @@ static struct my_file_struct *find_file(const int fd)
   return NULL;
 }
 
-static bool check_valid_ptr(const void *ptr)
+/* Checks that the SIZE bytes starting at user address UADDR lie
+   entirely in user space, without wrapping around.  Kills the
+   process if not.  Whether the pages are actually mapped is not
+   checked here: touching an unmapped user page from the kernel
+   page-faults, and page_fault() terminates the process. */
+static void check_user_range(const void *uaddr, size_t size)
 {
-  /* Case that pointer is NULL. */
-  if (ptr == NULL)
+  const uint8_t *start = uaddr;
+  if (start == NULL || start + size < start || start + size > (const uint8_t *)PHYS_BASE)
   {
-    return false;
-  }
-  /* Check whether it's user vaddr. */
-  if (!is_user_vaddr(ptr))
-  {
-    return false;
-  }
-  /* Check whether we get can get page from pagedir. */
-  if (pagedir_get_page(thread_current()->pagedir, ptr) == NULL)
-  {
-    return false;
+    thread_exit_with_code(-1);
   }
-  return true;
 }
 
-static void check_ptr(const void *ptr)
+/* Copies SIZE bytes from user address USRC to kernel address DST,
+   killing the process if USRC is bad.  Must not be called with
+   any lock held, since a fault terminates the process. */
+static void copy_in(void *dst, const void *usrc, size_t size)
 {
+  check_user_range(usrc, size);
+  memcpy(dst, usrc, size);
+}
 
-  /* Check the pointer itself whether it's valid. */
-  if (!check_valid_ptr(ptr))
-  {
-    thread_exit_with_code(-1);
-  }
+/* Copies SIZE bytes from kernel address SRC to user address UDST,
+   killing the process if UDST is bad.  Must not be called with
+   any lock held. */
+static void copy_out(void *udst, const void *src, size_t size)
+{
+  check_user_range(udst, size);
+  memcpy(udst, src, size);
 }
 
-static void check_ptr_2(const void *ptr, int size)
+#ifdef VM
+/* Unpins the pages of the SIZE-byte user buffer UADDR. */
+static void unpin_user_buffer(const void *uaddr, size_t size)
 {
+  for (const uint8_t *p = pg_round_down(uaddr); p < (const uint8_t *)uaddr + size; p += PGSIZE)
+    sup_page_unpin(p);
+}
 
-  /* Check the end of the buffer whether it's valid. */
-  if (!check_valid_ptr(ptr + size - 1))
+/* Pins each page of the SIZE-byte user buffer UADDR in memory,
+   checking that it is writable if WRITE is true, so that the
+   kernel can use the buffer while holding the file system lock
+   without taking a page fault.  Kills the process if the buffer
+   is bad.  Undo with unpin_user_buffer(). */
+static void pin_user_buffer(const void *uaddr, size_t size, bool write)
+{
+  if (size == 0)
+    return;
+  check_user_range(uaddr, size);
+  for (const uint8_t *p = pg_round_down(uaddr); p < (const uint8_t *)uaddr + size; p += PGSIZE)
+    if (!sup_page_pin(p, write))
+    {
+      unpin_user_buffer(uaddr, p - (const uint8_t *)uaddr);
+      thread_exit_with_code(-1);
+    }
+}
+#else
+/* Touches one byte in each page of the SIZE-byte user buffer
+   UADDR, writing it back unchanged if WRITE is true, so that a
+   bad buffer faults here, before the caller takes any lock,
+   rather than halfway through a file operation. */
+static void pin_user_buffer(const void *uaddr, size_t size, bool write)
+{
+  if (size == 0)
+    return;
+  check_user_range(uaddr, size);
+  for (volatile uint8_t *p = pg_round_down(uaddr); (const uint8_t *)p < (const uint8_t *)uaddr + size; p += PGSIZE)
   {
-    thread_exit_with_code(-1);
+    volatile uint8_t *q = p < (volatile uint8_t *)uaddr ? (volatile uint8_t *)uaddr : p;
+    uint8_t byte = *q;
+    if (write)
+      *q = byte;
   }
-  /* Check each page of the buffer whether it's valid. */
-  for (const void *flag = ptr; flag < ptr + size; flag += PGSIZE)
+}
+
+/* Without VM, pages never leave memory, so there is nothing to
+   undo. */
+static void unpin_user_buffer(const void *uaddr UNUSED, size_t size UNUSED)
+{
+}
+#endif
+
+/* Copies the null-terminated string at user address US into a
+   newly malloc()'d kernel buffer and returns it.  The caller must
+   free() it.  Kills the process if US is bad. */
+static char *copy_in_string(const char *us)
+{
+  const char *p = us;
+  char *ks;
+  size_t len;
+
+  /* Find the terminator.  Each byte is in user space, and a
+     missing page is caught by page_fault(). */
+  do
   {
-    if (!check_valid_ptr(flag))
+    if (p == NULL || !is_user_vaddr(p))
       thread_exit_with_code(-1);
-  }
+  } while (*p++ != '\0');
+
+  len = p - us;
+  ks = malloc(len);
+  if (ks == NULL)
+    thread_exit_with_code(-1);
+  memcpy(ks, us, len);
+  return ks;
 }
 
 void thread_exit_with_code(int code)
@@ -91,342 +252,443 @@ void syscall_init(void)
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
   /* Init the lock. */
   lock_init(&my_lock);
+  slab_cache_init(&file_struct_cache, "fd", sizeof(struct my_file_struct), NULL);
+#ifdef VM
+  slab_cache_init(&mmap_struct_cache, "mmap", sizeof(struct my_mmap_struct), NULL);
+#endif
 }
 
 static void
 syscall_handler(struct intr_frame *f)
 {
-  /* For each pointer and its content if it is a pointer to pointer,
-     check whether it is valid and safe to do syscall. */
-  check_ptr(f->esp);
-  switch (*(int *)f->esp)
-  {
-  case SYS_HALT:
-  {
-    /* Simply power off. */
-    shutdown_power_off();
-    break;
-  }
-  case SYS_EXIT:
-  {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    int state = *((int *)f->esp + 1);
-    /* Save the exit state in TCB. */
-    thread_current()->exit_state = state;
-    thread_exit();
-    break;
-  }
-  case SYS_EXEC:
-  {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(*(ptr + 1));
-    const char *cmd_line = *((char **)f->esp + 1);
-    /* Excute the program. */
-    acquire_l();
-    tid_t tid = process_execute(cmd_line);
-    release_l();
-    /* The last child is the newly create process. */
-    struct thread *child = list_entry(list_back(&thread_current()->children), struct thread, child_elem);
-    /* Return load success or not. */
-    if (!child->load_success)
-      f->eax = -1;
-    else
-      f->eax = tid;
-    break;
-  }
-  case SYS_WAIT:
-  {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    tid_t tid = *((int *)f->esp + 1);
-    /* All done in process_wait, return the child process's exit state,
-       or -1 if invalid call. */
-    f->eax = process_wait(tid);
-    break;
-  }
-  case SYS_CREATE:
+  uint32_t args[SYSCALL_MAX_ARGS];
+  const struct syscall *sc;
+  struct syscall_stats *stats;
+  enum intr_level old_level;
+  int64_t start_usecs;
+  int nr;
+
+#ifdef VM
+  /* Page faults taken on our behalf judge stack growth by it. */
+  thread_current()->user_esp = f->esp;
+#endif
+  /* Fetch the system call number, then its whole argument block
+     with a single range check. */
+  copy_in(&nr, f->esp, sizeof nr);
+  if (nr < 0 || (size_t)nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(ptr + 2);
-    check_ptr(*(ptr + 1));
-    /* Creates a new file called file. */
-    acquire_l();
-    f->eax = filesys_create(*(const char **)(ptr + 1), *((int *)(ptr + 2)));
-    release_l();
-    break;
+    thread_exit_with_code(-1);
   }
-  case SYS_REMOVE:
+  sc = &syscall_table[nr];
+  copy_in(args, (uint32_t *)f->esp + 1, sizeof *args * sc->argc);
+
+  /* Note the call before running it, since exit and halt never
+     return, but count it and its latency together afterward. */
+  stats = &syscall_stats[nr];
+  old_level = intr_disable();
+  stats->started++;
+  intr_set_level(old_level);
+
+  start_usecs = timer_usecs();
+  f->eax = sc->func(args);
+  int64_t usecs = timer_usecs() - start_usecs;
+
+  old_level = intr_disable();
+  stats->calls++;
+  stats->usecs += usecs;
+  intr_set_level(old_level);
+}
+
+/* Prints system call statistics. */
+void syscall_print_stats(void)
+{
+  long long total = 0;
+  for (size_t nr = 0; nr < SYSCALL_CNT; nr++)
+    total += syscall_stats[nr].started;
+  printf("Syscall: %lld calls\n", total);
+
+  for (size_t nr = 0; nr < SYSCALL_CNT; nr++)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(*(ptr + 1));
-    /* Deletes the file called file. */
-    acquire_l();
-    f->eax = filesys_remove(*(const char **)(ptr + 1));
-    release_l();
-    break;
+    const struct syscall_stats *stats = &syscall_stats[nr];
+    if (stats->started > 0)
+      printf("  %-8s %8lld calls, %12" PRId64 " us (%" PRId64 " avg), "
+             "%lld not returned\n",
+             syscall_table[nr].name, stats->calls, stats->usecs,
+             stats->calls > 0 ? stats->usecs / stats->calls : 0,
+             stats->started - stats->calls);
   }
-  case SYS_OPEN:
+}
+
+static uint32_t sys_halt(const uint32_t *args UNUSED)
+{
+  /* Simply power off. */
+  shutdown_power_off();
+  NOT_REACHED();
+}
+
+static uint32_t sys_exit(const uint32_t *args)
+{
+  /* Save the exit state in TCB. */
+  thread_exit_with_code((int)args[0]);
+  NOT_REACHED();
+}
+
+static uint32_t sys_exec(const uint32_t *args)
+{
+  char *cmd_line = copy_in_string((const char *)args[0]);
+  /* Excute the program.  This waits for the child to load, so it
+     must not hold the file system lock. */
+  tid_t tid = process_execute(cmd_line);
+  free(cmd_line);
+  /* TID_ERROR if the program did not load. */
+  return tid;
+}
+
+static uint32_t sys_wait(const uint32_t *args)
+{
+  /* All done in process_wait, return the child process's exit state,
+     or -1 if invalid call. */
+  return process_wait((tid_t)args[0]);
+}
+
+static uint32_t sys_create(const uint32_t *args)
+{
+  char *name = copy_in_string((const char *)args[0]);
+  /* Creates a new file called file. */
+  acquire_l();
+  bool success = filesys_create(name, (off_t)args[1]);
+  release_l();
+  free(name);
+  return success;
+}
+
+static uint32_t sys_remove(const uint32_t *args)
+{
+  char *name = copy_in_string((const char *)args[0]);
+  /* Deletes the file called file. */
+  acquire_l();
+  bool success = filesys_remove(name);
+  release_l();
+  free(name);
+  return success;
+}
+
+static uint32_t sys_open(const uint32_t *args)
+{
+  char *name = copy_in_string((const char *)args[0]);
+  int fd = -1;
+  /* Opens the file called file. */
+  acquire_l();
+  struct file *my_file = filesys_open(name);
+  /* Check if file exists. */
+  if (my_file)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(*(ptr + 1));
-    /* Opens the file called file. */
-    acquire_l();
-    struct file *my_file = filesys_open(*(const char **)(ptr + 1));
-    /* Check if file exists. */
-    if (!my_file)
+    /* File exists, save infos into a struct. */
+    struct thread *t = thread_current();
+    struct my_file_struct *file_thread = slab_alloc(&file_struct_cache);
+    if (file_thread == NULL)
     {
-      f->eax = -1;
+      /* Out of memory: give the file back and fail. */
+      file_close(my_file);
     }
     else
     {
-      /* File exists, save infos into a struct. */
-      struct thread *t = thread_current();
-      struct my_file_struct *file_thread = malloc(sizeof(struct my_file_struct));
       file_thread->fd = t->fd++;
       file_thread->file = my_file;
       /* Push into the list. */
       list_push_back(&t->files, &file_thread->elem);
-      f->eax = file_thread->fd;
+      fd = file_thread->fd;
     }
-    release_l();
-    break;
   }
-  case SYS_FILESIZE:
+  release_l();
+  free(name);
+  return fd;
+}
+
+static uint32_t sys_filesize(const uint32_t *args)
+{
+  /* Find the file with certain fd. */
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  if (cur_file == NULL)
+    return -1;
+  /* Get the filesize. */
+  acquire_l();
+  off_t length = file_length(cur_file->file);
+  release_l();
+  return length;
+}
+
+static uint32_t sys_read(const uint32_t *args)
+{
+  int fd = (int)args[0];
+  void *buffer = (void *)args[1];
+  unsigned size = args[2];
+  /* Fd 0 reads from the keyboard: whatever is already typed, up
+     to the end of the line, without waiting for SIZE bytes.  The
+     input buffer can't hold more than INTQ_BUFSIZE keys anyway.
+     Bring in the buffer for writing first, so that a bad one
+     doesn't swallow a key. */
+  if (fd == 0)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    /* Find the file with certain fd. */
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    /* Get the filesize. */
-    acquire_l();
-    f->eax = file_length(cur_file->file);
-    release_l();
-    break;
+    uint8_t keys[INTQ_BUFSIZE];
+    size_t want = size < sizeof keys ? size : sizeof keys;
+    if (want == 0)
+      return 0;
+    pin_user_buffer(buffer, want, true);
+    size_t n = input_getbuf(keys, want);
+    copy_out(buffer, keys, n);
+    unpin_user_buffer(buffer, want);
+    return n;
   }
-  case SYS_READ:
+  /* Bring in the whole buffer before touching any lock. */
+  pin_user_buffer(buffer, size, true);
+  /* Reads size bytes from the file open as fd into buffer. */
+  struct my_file_struct *cur_file = find_file(fd);
+  off_t bytes_read = -1;
+  if (cur_file != NULL)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(ptr + 2);
-    check_ptr(ptr + 3);
-    /* Get all the input. */
-    int fd = *((int *)f->esp + 1);
-    const void *buffer = (const void *)(*((int *)f->esp + 2));
-    unsigned size = *((unsigned *)f->esp + 3);
-    check_ptr_2(*(ptr + 2), size);
-    /* Fd 0 reads from the keyboard. */
-    if (fd == 0)
-    {
-      char *temp = buffer;
-      for (size_t i = 0; i < size; i++, temp++)
-      {
-        *temp = input_getc();
-      }
-      f->eax = size;
-    }
-    else
-    {
-      /* Reads size bytes from the file open as fd into buffer. */
-      struct my_file_struct *cur_file = find_file(fd);
-      /* Check if file exists. */
-      if (cur_file)
-      {
-        acquire_l();
-        f->eax = file_read(cur_file->file, buffer, size);
-        release_l();
-      }
-      else
-      {
-        /* Case that file doesn't exist. */
-        f->eax = -1;
-      }
-    }
-    break;
+    acquire_l();
+    bytes_read = file_read(cur_file->file, buffer, size);
+    release_l();
   }
-  case SYS_WRITE:
-  {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(ptr + 2);
-    check_ptr(ptr + 3);
-    /* Get all the input. */
-    int fd = *((int *)f->esp + 1);
-    const void *buffer = (const void *)(*((int *)f->esp + 2));
-    unsigned size = *((unsigned *)f->esp + 3);
-    check_ptr_2(*(ptr + 2), size);
-    /* Fd 1 writes to the console. */
-    if (fd == 1)
-    {
+  unpin_user_buffer(buffer, size);
+  return bytes_read;
+}
 
-      putbuf((const char *)buffer, size);
-      f->eax = strlen(buffer);
-    }
-    else
-    {
-      /* Writes size bytes from buffer to the open file fd. */
-      struct my_file_struct *cur_file = find_file(fd);
-      if (cur_file)
-      {
-        acquire_l();
-        f->eax = file_write(cur_file->file, buffer, size);
-        release_l();
-      }
-      else
-      {
-        /* Case that file doesn't exist. */
-        f->eax = 0;
-      }
-    }
-    break;
-  }
-  case SYS_SEEK:
+static uint32_t sys_write(const uint32_t *args)
+{
+  int fd = (int)args[0];
+  const void *buffer = (const void *)args[1];
+  unsigned size = args[2];
+  /* Bring in the whole buffer before touching any lock. */
+  pin_user_buffer(buffer, size, false);
+  off_t bytes_written = 0;
+  /* Fd 1 writes to the console. */
+  if (fd == 1)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    if (cur_file)
-    {
-      /* Changes the next byte to be read or written in open file fd to position,
-      expressed in bytes from the beginning of the file.  */
-      acquire_l();
-      file_seek(cur_file->file, *((unsigned *)f->esp + 2));
-      release_l();
-    }
-
-    break;
+    putbuf((const char *)buffer, size);
+    bytes_written = size;
   }
-  case SYS_TELL:
+  else
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    if (cur_file)
+    /* Writes size bytes from buffer to the open file fd. */
+    struct my_file_struct *cur_file = find_file(fd);
+    if (cur_file != NULL)
     {
-      /* Returns the position of the next byte to be read or written in open file fd,
-      expressed in bytes from the beginning of the file. */
       acquire_l();
-      f->eax = file_tell(cur_file->file);
+      bytes_written = file_write(cur_file->file, buffer, size);
       release_l();
     }
-    else
-    {
-      /* Case that file doesn't exist. */
-      f->eax = -1;
-    }
-    break;
   }
-  case SYS_CLOSE:
+  unpin_user_buffer(buffer, size);
+  return bytes_written;
+}
+
+static uint32_t sys_seek(const uint32_t *args)
+{
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  if (cur_file)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    /* Case that file doesn't exist. */
-    if (cur_file == NULL)
-    {
-      break;
-    }
-    /* Closes file descriptor fd.
-    Exiting or terminating a process implicitly closes all its open file descriptors,
-    as if by calling this function for each one. */
+    /* Changes the next byte to be read or written in open file fd to position,
+    expressed in bytes from the beginning of the file.  */
     acquire_l();
-    file_close(cur_file->file);
+    file_seek(cur_file->file, (unsigned)args[1]);
     release_l();
-    /* Remove elem from list, and free the space we allocated. */
-    list_remove(&cur_file->elem);
-    free(cur_file);
-    break;
   }
-  case SYS_CHDIR:
+  return 0;
+}
+
+static uint32_t sys_tell(const uint32_t *args)
+{
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  /* Case that file doesn't exist. */
+  if (cur_file == NULL)
+    return -1;
+  /* Returns the position of the next byte to be read or written in open file fd,
+  expressed in bytes from the beginning of the file. */
+  acquire_l();
+  off_t position = file_tell(cur_file->file);
+  release_l();
+  return position;
+}
+
+static uint32_t sys_close(const uint32_t *args)
+{
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  /* Case that file doesn't exist. */
+  if (cur_file == NULL)
+    return 0;
+  /* Closes file descriptor fd.
+  Exiting or terminating a process implicitly closes all its open file descriptors,
+  as if by calling this function for each one. */
+  acquire_l();
+  file_close(cur_file->file);
+  release_l();
+  /* Remove elem from list, and free the space we allocated. */
+  list_remove(&cur_file->elem);
+  slab_free(cur_file);
+  return 0;
+}
+
+static uint32_t sys_chdir(const uint32_t *args)
+{
+  char *name = copy_in_string((const char *)args[0]);
+  /* Change current directory. */
+  bool success = filesys_chdir(name);
+  free(name);
+  return success;
+}
+
+static uint32_t sys_mkdir(const uint32_t *args)
+{
+  char *name = copy_in_string((const char *)args[0]);
+  /* Create a new directory. */
+  acquire_l();
+  bool success = filesys_mkdir(name, 0);
+  release_l();
+  free(name);
+  return success;
+}
+
+static uint32_t sys_readdir(const uint32_t *args)
+{
+  char name[NAME_MAX + 1];
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  /* If input is indeed a directory, read next entry. */
+  if (cur_file == NULL || !inode_isdir(file_get_inode(cur_file->file)))
+    return false;
+  struct dir *dir = (struct dir *)(cur_file->file);
+  if (!dir_readdir(dir, name))
+    return false;
+  copy_out((char *)args[1], name, strlen(name) + 1);
+  return true;
+}
+
+static uint32_t sys_isdir(const uint32_t *args)
+{
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  /* Determine whether input is a directory. */
+  return cur_file != NULL && inode_isdir(file_get_inode(cur_file->file));
+}
+
+static uint32_t sys_inumber(const uint32_t *args)
+{
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  /* Return the inode number of the input. */
+  if (cur_file == NULL)
+    return -1;
+  return inode_get_inumber(file_get_inode(cur_file->file));
+}
+
+#ifdef VM
+/* Finds the current thread's mapping with id MAPID. */
+static struct my_mmap_struct *find_mmap(int mapid)
+{
+  struct list *mmaps = &thread_current()->mmaps;
+  for (struct list_elem *e = list_begin(mmaps); e != list_end(mmaps); e = list_next(e))
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(*(ptr + 1));
-    /* Change current directory. */
-    f->eax = filesys_chdir(*(const char **)(ptr + 1));
-    break;
+    struct my_mmap_struct *m = list_entry(e, struct my_mmap_struct, elem);
+    if (m->mapid == mapid)
+      return m;
   }
-  case SYS_MKDIR:
+  return NULL;
+}
+
+/* Removes the first PAGE_CNT pages at ADDR from the current
+   process's address space, writing modified ones back. */
+static void unmap_pages(uint8_t *addr, size_t page_cnt)
+{
+  for (size_t i = 0; i < page_cnt; i++)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(*(ptr + 1));
-    /* Create a new directory. */
-    acquire_l();
-    f->eax = filesys_mkdir(*(const char **)(ptr + 1), 0);
-    release_l();
-    break;
+    struct sup_pt_elem *page = find_pt_elem(thread_current(), addr + i * PGSIZE);
+    if (page != NULL)
+      sup_page_remove(page);
   }
-  case SYS_READDIR:
+}
+
+/* Unmaps M, writes its modified pages back, and frees it. */
+static void munmap_one(struct my_mmap_struct *m)
+{
+  unmap_pages(m->addr, m->page_cnt);
+  acquire_l();
+  file_close(m->file);
+  release_l();
+  list_remove(&m->elem);
+  slab_free(m);
+}
+
+static uint32_t sys_mmap(const uint32_t *args)
+{
+  struct thread *t = thread_current();
+  struct my_file_struct *cur_file = find_file((int)args[0]);
+  uint8_t *addr = (uint8_t *)args[1];
+  struct my_mmap_struct *m;
+  struct file *file;
+  off_t length;
+  size_t page_cnt;
+
+  /* Maps the file open as fd at page-aligned, non-null addr. */
+  if (cur_file == NULL || addr == NULL || pg_ofs(addr) != 0 || !is_user_vaddr(addr))
+    return -1;
+  acquire_l();
+  file = file_reopen(cur_file->file);
+  length = file != NULL ? file_length(file) : 0;
+  release_l();
+
+  /* The file must be non-empty, fit below PHYS_BASE, and not
+     overlap any page already in use. */
+  page_cnt = DIV_ROUND_UP(length, PGSIZE);
+  bool ok = length > 0 && page_cnt <= (size_t)((uint8_t *)PHYS_BASE - addr) / PGSIZE;
+  for (size_t i = 0; ok && i < page_cnt; i++)
+    ok = find_pt_elem(t, addr + i * PGSIZE) == NULL;
+  m = ok ? slab_alloc(&mmap_struct_cache) : NULL;
+  if (m == NULL)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    check_ptr(ptr + 2);
-    check_ptr(*(ptr + 2));
-    int fd = *((int *)f->esp + 1);
-    char *name = *(const char **)(ptr + 2);
-    struct my_file_struct *cur_file = find_file(fd);
-    /* If input is indeed a directory, read next entry. */
-    if (inode_isdir(file_get_inode(cur_file->file)))
-    {
-      struct dir *dir = (struct dir *)(cur_file->file);
-      f->eax = dir_readdir(dir, name);
-    }
-    else
-    {
-      f->eax = false;
-      break;
-    }
-    break;
+    acquire_l();
+    file_close(file);
+    release_l();
+    return -1;
   }
-  case SYS_ISDIR:
-  {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    /* Determine whether input is a directory. */
-    if (cur_file)
-    {
-      f->eax = inode_isdir(file_get_inode(cur_file->file));
-    }
 
-    break;
-  }
-  case SYS_INUMBER:
+  /* Record the pages; they are read in as they are touched. */
+  for (size_t i = 0; i < page_cnt; i++)
   {
-    /* Check if the pointer is valid. */
-    uint32_t *ptr = (uint32_t *)f->esp;
-    check_ptr(ptr + 1);
-    struct my_file_struct *cur_file = find_file(*((int *)f->esp + 1));
-    /* Return the inode number of the input. */
-    if (cur_file)
+    off_t ofs = i * PGSIZE;
+    size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+    if (!sup_page_add_mmap(addr + ofs, file, ofs, read_bytes))
     {
-      f->eax = inode_get_inumber(file_get_inode(cur_file->file));
+      unmap_pages(addr, i);
+      acquire_l();
+      file_close(file);
+      release_l();
+      slab_free(m);
+      return -1;
     }
-    break;
-  }
   }
+  m->mapid = t->mapid++;
+  m->file = file;
+  m->addr = addr;
+  m->page_cnt = page_cnt;
+  list_push_back(&t->mmaps, &m->elem);
+  return m->mapid;
+}
+
+static uint32_t sys_munmap(const uint32_t *args)
+{
+  struct my_mmap_struct *m = find_mmap((int)args[0]);
+  if (m != NULL)
+    munmap_one(m);
+  return 0;
+}
+
+/* Unmaps all of the current process's mappings, as happens
+   implicitly when a process exits. */
+void munmap_all()
+{
+  while (!list_empty(&thread_current()->mmaps))
+    munmap_one(list_entry(list_front(&thread_current()->mmaps), struct my_mmap_struct, elem));
 }
+#endif
 
 void close_all_files()
 {
@@ -439,20 +701,27 @@ void close_all_files()
     file_close(cur_file->file);
     list_remove(&cur_file->elem);
     /* Free the space. */
-    free(cur_file);
+    slab_free(cur_file);
   }
 }
 
-void push_file(struct file *file)
+/* Adds FILE to the current thread's open files.  Returns false,
+   closing FILE, if memory runs out. */
+bool push_file(struct file *file)
 {
   /* Push the file into the list in thread, save info. */
   struct thread *t = thread_current();
-  struct my_file_struct *file_thread = malloc(sizeof(struct my_file_struct));
+  struct my_file_struct *file_thread = slab_alloc(&file_struct_cache);
+  if (file_thread == NULL)
+  {
+    file_close(file);
+    return false;
+  }
   file_thread->fd = t->fd++;
   file_thread->file = file;
   /* Push into the list. */
   list_push_back(&t->files, &file_thread->elem);
-  return file;
+  return true;
 }
 
 /* Accquie the lock. */
@@ -467,6 +736,18 @@ void release_l()
   lock_release(&my_lock);
 }
 
+/* Acquire the lock if it is free, without waiting. */
+bool try_acquire_l()
+{
+  return lock_try_acquire(&my_lock);
+}
+
+/* Whether the current thread holds the lock. */
+bool holding_l()
+{
+  return lock_held_by_current_thread(&my_lock);
+}
+
 /* Get file from my_file_struct. */
 struct file *myfile_get_file(struct my_file_struct *my_file)
 {
@@ -477,4 +758,4 @@ struct file *myfile_get_file(struct my_file_struct *my_file)
 struct my_file_struct *elem_to_myfile(struct list_elem *e)
 {
   return list_entry(e, struct my_file_struct, elem);
-}
\ No newline at end of file
+}
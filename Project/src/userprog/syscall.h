@@ -1,6 +1,22 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <debug.h>
+#include <stdbool.h>
+
+struct file;
+
 void syscall_init (void);
+void syscall_print_stats (void);
+void thread_exit_with_code (int code) NO_RETURN;
+void close_all_files (void);
+bool push_file (struct file *);
+void acquire_l (void);
+void release_l (void);
+bool try_acquire_l (void);
+bool holding_l (void);
+#ifdef VM
+void munmap_all (void);
+#endif
 
 #endif /* userprog/syscall.h */
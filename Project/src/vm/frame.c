@@ -0,0 +1,520 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every user pool frame that holds a page of some process is in
+   FRAME_LIST.  When the user pool runs dry, the clock algorithm
+   sweeps FRAME_LIST for a few frames whose pages have not been
+   accessed since the last sweep, saves those pages to swap if it
+   has to, hands one frame to the new page and returns the rest to
+   the user pool.
+
+   Shared frames are also in SHARE_TABLE, hashed by the inode and
+   offset of the file data that they hold.
+
+   FRAME_LOCK protects FRAME_LIST, SHARE_TABLE, CLOCK_HAND, each
+   frame's members, and the FRAME and SWAP_SLOT members of each
+   page that is in the table or being evicted from it.  It is held
+   across the swap write of an eviction, so that the owner of the
+   page cannot fault it back in before it is safely on disk. */
+static struct list frame_list;
+static struct hash share_table;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+
+/* The zero frame.  Not in FRAME_LIST, and permanently pinned. */
+static struct frame zero_frame;
+
+/* Number of pages evicted together when the user pool runs
+   dry. */
+#define EVICT_CLUSTER 8
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static void frame_destroy (struct frame *);
+static struct frame *evict (void);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  hash_init (&share_table, share_hash, share_less, NULL);
+  lock_init (&frame_lock);
+  clock_hand = list_end (&frame_list);
+
+  zero_frame.kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (zero_frame.kpage == NULL)
+    PANIC ("no memory for zero frame");
+  list_init (&zero_frame.pages);
+  zero_frame.pin_cnt = 1;
+  zero_frame.inode = NULL;
+}
+
+/* Obtains a frame from the user pool, without evicting anything.
+   The frame is returned pinned and with no pages; the caller
+   fills it, adds its page with frame_attach(), and unpins it with
+   frame_unpin() once the page is mapped.  Returns a null pointer
+   if the user pool is exhausted. */
+struct frame *
+frame_try_alloc (void)
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f != NULL)
+        {
+          f->kpage = kpage;
+          list_init (&f->pages);
+          f->pin_cnt = 1;
+          f->inode = NULL;
+          list_push_back (&frame_list, &f->elem);
+        }
+      else
+        palloc_free_page (kpage);
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Obtains a frame, as frame_try_alloc() does, evicting other
+   pages if the user pool is exhausted.  Returns a null pointer if
+   no frame can be freed. */
+struct frame *
+frame_alloc (void)
+{
+  struct frame *f = frame_try_alloc ();
+
+  if (f == NULL)
+    {
+      lock_acquire (&frame_lock);
+      f = evict ();
+      lock_release (&frame_lock);
+    }
+  return f;
+}
+
+/* Frees F, which must have no pages. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (list_empty (&f->pages));
+  frame_destroy (f);
+  lock_release (&frame_lock);
+}
+
+/* Records that PAGE is mapped to F. */
+void
+frame_attach (struct frame *f, struct sup_pt_elem *page)
+{
+  lock_acquire (&frame_lock);
+  list_push_back (&f->pages, &page->frame_elem);
+  page->frame = f;
+  lock_release (&frame_lock);
+}
+
+/* Detaches PAGE from its frame and unmaps it.  FRAME_LOCK must
+   be held. */
+static void
+frame_detach (struct sup_pt_elem *page)
+{
+  pagedir_clear_page (page->owner->pagedir, page->vaddr);
+  list_remove (&page->frame_elem);
+  page->frame = NULL;
+}
+
+/* Removes PAGE from memory, if it is resident, and frees its
+   frame unless other pages still map it.  The page's owner must
+   be the current thread. */
+void
+frame_free_page (struct sup_pt_elem *page)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = page->frame;
+  if (f != NULL)
+    {
+      frame_detach (page);
+      if (list_empty (&f->pages) && f != &zero_frame)
+        frame_destroy (f);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Pins PAGE's frame, if PAGE is resident, and returns true.
+   Returns false if PAGE is not resident. */
+bool
+frame_pin_page (struct sup_pt_elem *page)
+{
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  resident = page->frame != NULL;
+  if (resident)
+    page->frame->pin_cnt++;
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Undoes one pin of F. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Looks for a shared frame holding READ_BYTES bytes of INODE at
+   OFS, followed by zeros.  If there is one, attaches PAGE to it
+   and returns it, pinned.  Otherwise returns a null pointer.  A
+   page that is in swap is never shared, since it may have been
+   modified. */
+struct frame *
+frame_share (struct sup_pt_elem *page, struct inode *inode, off_t ofs,
+             size_t read_bytes)
+{
+  struct frame key, *f = NULL;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&frame_lock);
+  if (page->swap_slot == SWAP_SLOT_NONE)
+    {
+      e = hash_find (&share_table, &key.share_elem);
+      if (e != NULL)
+        {
+          f = hash_entry (e, struct frame, share_elem);
+          f->pin_cnt++;
+          list_push_back (&f->pages, &page->frame_elem);
+          page->frame = f;
+        }
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Enters F, which holds READ_BYTES bytes of INODE at OFS followed
+   by zeros, in the shared frame table.  Does nothing if another
+   frame already holds the same data. */
+void
+frame_publish (struct frame *f, struct inode *inode, off_t ofs,
+               size_t read_bytes)
+{
+  lock_acquire (&frame_lock);
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+  if (hash_insert (&share_table, &f->share_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Returns true if F is in the shared frame table, in which case
+   its pages must be mapped read-only. */
+bool
+frame_is_shared (const struct frame *f)
+{
+  return f->inode != NULL || f == &zero_frame;
+}
+
+/* If PAGE is the only page mapped to its frame, takes the frame
+   out of the shared frame table, so that PAGE may write it, and
+   returns true.  Returns false if other pages map the frame too,
+   or if it is the zero frame.  PAGE must be pinned. */
+bool
+frame_unshare (struct sup_pt_elem *page)
+{
+  struct frame *f = page->frame;
+  bool sole;
+
+  lock_acquire (&frame_lock);
+  ASSERT (f != NULL && f->pin_cnt > 0);
+  sole = f != &zero_frame && list_size (&f->pages) == 1;
+  if (sole && f->inode != NULL)
+    {
+      hash_delete (&share_table, &f->share_elem);
+      f->inode = NULL;
+    }
+  lock_release (&frame_lock);
+  return sole;
+}
+
+/* Moves PAGE, which must be pinned, from its frame to frame TO,
+   which must hold a copy of its contents, and undoes the pin on
+   the old frame.  PAGE is left unmapped. */
+void
+frame_move (struct sup_pt_elem *page, struct frame *to)
+{
+  struct frame *from = page->frame;
+
+  lock_acquire (&frame_lock);
+  ASSERT (from != NULL && from->pin_cnt > 0);
+  frame_detach (page);
+  from->pin_cnt--;
+  if (list_empty (&from->pages) && from != &zero_frame)
+    frame_destroy (from);
+  list_push_back (&to->pages, &page->frame_elem);
+  page->frame = to;
+  lock_release (&frame_lock);
+}
+
+/* Attaches PAGE, which must be all zeros, to the zero frame and
+   returns the zero frame, pinned.  Returns a null pointer if PAGE
+   is in swap, since it may have been modified. */
+struct frame *
+frame_share_zero (struct sup_pt_elem *page)
+{
+  struct frame *f = NULL;
+
+  lock_acquire (&frame_lock);
+  if (page->swap_slot == SWAP_SLOT_NONE)
+    {
+      f = &zero_frame;
+      f->pin_cnt++;
+      list_push_back (&f->pages, &page->frame_elem);
+      page->frame = f;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Returns a hash value for shared frame E. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  unsigned h = hash_bytes (&f->inode, sizeof f->inode);
+  return h ^ hash_int (f->ofs) ^ hash_int (f->read_bytes);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
+
+/* Advances the clock hand, wrapping around at the end of the
+   frame table, and returns the frame it passed. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* Removes F from the frame table and frees it.  FRAME_LOCK must
+   be held. */
+static void
+frame_destroy (struct frame *f)
+{
+  if (f->inode != NULL)
+    hash_delete (&share_table, &f->share_elem);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Returns true if any page mapped to F was accessed since the
+   last call, and clears their accessed bits.  FRAME_LOCK must be
+   held. */
+static bool
+frame_accessed (struct frame *f)
+{
+  bool accessed = false;
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct sup_pt_elem *page = list_entry (e, struct sup_pt_elem,
+                                             frame_elem);
+      uint32_t *pd = page->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, page->vaddr))
+        {
+          pagedir_set_accessed (pd, page->vaddr, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Maps F's only page back in, dirty, after it could not be
+   evicted. */
+static void
+frame_remap (struct frame *f)
+{
+  struct sup_pt_elem *page = list_entry (list_front (&f->pages),
+                                         struct sup_pt_elem, frame_elem);
+  uint32_t *pd = page->owner->pagedir;
+
+  pagedir_set_page (pd, page->vaddr, f->kpage, page->writable);
+  pagedir_set_dirty (pd, page->vaddr, true);
+  f->pin_cnt = 0;
+}
+
+/* Evicts up to EVICT_CLUSTER frames chosen by the clock
+   algorithm, writing the dirty pages to consecutive swap slots,
+   or back to their files if they are memory-mapped.  Shared
+   frames are never dirty.  Returns one of the freed frames, still
+   in the frame table and pinned, and gives the others back to the
+   user pool, so that the next few faults find a frame without
+   evicting.  Returns a null pointer if every frame is pinned or
+   no victim could be saved.  FRAME_LOCK must be held. */
+static struct frame *
+evict (void)
+{
+  struct frame *victims[EVICT_CLUSTER];
+  bool dirty[EVICT_CLUSTER];
+  size_t victim_cnt = 0, dirty_cnt = 0;
+  size_t tries = 2 * list_size (&frame_list);
+  struct frame *result = NULL;
+  size_t slot, i;
+
+  /* Writing back a mapped page needs the file system lock.  We
+     hold the frame table lock, so only try for it: whoever holds
+     it may be waiting for us. */
+  bool fs_held = holding_l ();
+  bool fs_locked = fs_held;
+  bool fs_tried = fs_held;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  while (victim_cnt < EVICT_CLUSTER && tries-- > 0)
+    {
+      struct frame *f = clock_next ();
+      struct list_elem *e;
+
+      /* Second chance. */
+      if (f->pin_cnt > 0 || frame_accessed (f))
+        continue;
+
+      /* Unmap the pages first, so that nobody can dirty the frame
+         behind our back; the dirty bit survives the unmapping.
+         Pin the frame so that the sweep doesn't pick it twice. */
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct sup_pt_elem *page = list_entry (e, struct sup_pt_elem,
+                                                 frame_elem);
+          pagedir_clear_page (page->owner->pagedir, page->vaddr);
+        }
+      dirty[victim_cnt] = false;
+      if (!frame_is_shared (f))
+        {
+          struct sup_pt_elem *page = list_entry (list_front (&f->pages),
+                                                 struct sup_pt_elem,
+                                                 frame_elem);
+          ASSERT (list_size (&f->pages) == 1);
+          dirty[victim_cnt] = pagedir_is_dirty (page->owner->pagedir,
+                                                page->vaddr);
+          if (dirty[victim_cnt] && page->mmap)
+            {
+              if (!fs_tried)
+                {
+                  fs_locked = try_acquire_l ();
+                  fs_tried = true;
+                }
+              if (!fs_locked)
+                {
+                  frame_remap (f);
+                  continue;
+                }
+            }
+          else
+            dirty_cnt += dirty[victim_cnt];
+        }
+      f->pin_cnt = 1;
+      victims[victim_cnt++] = f;
+    }
+
+  slot = swap_alloc (dirty_cnt);
+  for (i = 0; i < victim_cnt; i++)
+    {
+      struct frame *f = victims[i];
+      size_t s = SWAP_SLOT_NONE;
+
+      if (dirty[i])
+        {
+          struct sup_pt_elem *page = list_entry (list_front (&f->pages),
+                                                 struct sup_pt_elem,
+                                                 frame_elem);
+          if (page->mmap)
+            sup_page_write_back (page, f->kpage);
+          else
+            {
+              /* Fall back to scattered slots if there is no run
+                 long enough for the whole cluster. */
+              s = slot != SWAP_SLOT_NONE ? slot++ : swap_alloc (1);
+              if (s == SWAP_SLOT_NONE)
+                {
+                  /* Swap is full.  Put the page back. */
+                  frame_remap (f);
+                  continue;
+                }
+              swap_write (s, f->kpage);
+            }
+        }
+
+      /* The frame's pages now live elsewhere. */
+      while (!list_empty (&f->pages))
+        {
+          struct sup_pt_elem *page = list_entry (list_pop_front (&f->pages),
+                                                 struct sup_pt_elem,
+                                                 frame_elem);
+          page->swap_slot = s;
+          page->frame = NULL;
+        }
+      if (f->inode != NULL)
+        {
+          hash_delete (&share_table, &f->share_elem);
+          f->inode = NULL;
+        }
+
+      if (result == NULL)
+        result = f;
+      else
+        frame_destroy (f);
+    }
+  if (fs_locked && !fs_held)
+    release_l ();
+  return result;
+}
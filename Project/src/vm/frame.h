@@ -0,0 +1,56 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct sup_pt_elem;
+
+/* A frame of physical memory from the user pool.
+
+   A frame is usually mapped by a single page.  A frame holding an
+   unmodified page of an executable is entered in the shared frame
+   table under the part of the file it holds, and is then mapped,
+   read-only, by every process that runs the same executable and
+   needs that page.  It is freed when its last page goes.
+
+   All-zero pages that have never been written share a single
+   frame, the zero frame, which is never freed or evicted. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages mapped to it. */
+    int pin_cnt;                /* Nonzero: must not be evicted. */
+
+    /* Shared frames only. */
+    struct inode *inode;        /* File the contents came from, or NULL. */
+    off_t ofs;                  /* Offset in INODE. */
+    size_t read_bytes;          /* Bytes from INODE; the rest are zero. */
+    struct hash_elem share_elem; /* Element in the shared frame table. */
+
+    struct list_elem elem;      /* Element in the frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (void);
+struct frame *frame_try_alloc (void);
+void frame_free (struct frame *);
+void frame_attach (struct frame *, struct sup_pt_elem *);
+void frame_free_page (struct sup_pt_elem *);
+bool frame_pin_page (struct sup_pt_elem *);
+void frame_unpin (struct frame *);
+
+struct frame *frame_share (struct sup_pt_elem *, struct inode *, off_t ofs,
+                           size_t read_bytes);
+void frame_publish (struct frame *, struct inode *, off_t ofs,
+                    size_t read_bytes);
+bool frame_is_shared (const struct frame *);
+bool frame_unshare (struct sup_pt_elem *);
+void frame_move (struct sup_pt_elem *, struct frame *);
+struct frame *frame_share_zero (struct sup_pt_elem *);
+
+#endif /* vm/frame.h */
@@ -1,27 +1,41 @@
-#include "page.h"
+#include "vm/page.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
-#include <list.h>
 #include <hash.h>
-#include "devices/timer.h"
-#include "threads/synch.h"
-#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
-#include "threads/pte.h"
-#include "userprog/pagedir.h"
-#include "swap.h"
 #include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "filesys/file.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Maximum size of a process's stack, in pages. */
+size_t stack_max_pages = 2048;          /* 8 MB. */
+
+/* Number of pages on each side of a page faulted in from swap
+   that are considered for reading in along with it. */
+#define SWAP_READ_AROUND 2
+
+/* Cache of struct sup_pt_elem. */
+static struct slab_cache sup_pt_cache;
 
-unsigned sup_page_hash (const struct hash_elem *e, void *aux){
+/* Initializes the supplemental page table module. */
+void sup_page_init(void){
+    slab_cache_init (&sup_pt_cache, "page", sizeof (struct sup_pt_elem), NULL);
+}
+
+static unsigned sup_page_hash (const struct hash_elem *e, void *aux UNUSED){
     struct sup_pt_elem *page = hash_entry (e, struct sup_pt_elem, hash_elem);
-    unsigned result = hash_int (page->vaddr);
+    unsigned result = hash_int ((int) page->vaddr);
     return result;
 }
 
 
-bool sup_page_less (const struct hash_elem *a,const struct hash_elem *b,void *aux){
+static bool sup_page_less (const struct hash_elem *a,const struct hash_elem *b,void *aux UNUSED){
     const struct sup_pt_elem *left = hash_entry (a, struct sup_pt_elem, hash_elem);
     const struct sup_pt_elem *right = hash_entry (b, struct sup_pt_elem, hash_elem);
     bool result = left->vaddr<right->vaddr;
@@ -30,16 +44,60 @@ bool sup_page_less (const struct hash_elem *a,const struct hash_elem *b,void *au
 }
 
 
-void sup_page_delete(struct hash_elem *e, void *aux){
+/* Writes PAGE's contents at KPAGE back to its file.  The file
+   system lock must be held. */
+void sup_page_write_back(struct sup_pt_elem *page, const void *kpage){
+    ASSERT (page->mmap);
+    ASSERT (holding_l ());
+    file_write_at (page->file, kpage, page->read_bytes, page->ofs);
+}
+
+/* Frees PAGE's frame and swap slot, first writing it back to its
+   file if it is a modified memory-mapped page. */
+static void sup_page_release(struct sup_pt_elem *page){
+    if (page->mmap && frame_pin_page (page))
+    {
+        if (pagedir_is_dirty (page->owner->pagedir, page->vaddr))
+        {
+            bool held = holding_l ();
+
+            if (!held)
+                acquire_l ();
+            sup_page_write_back (page, page->frame->kpage);
+            if (!held)
+                release_l ();
+        }
+        frame_unpin (page->frame);
+    }
+    frame_free_page (page);
+    if (page->swap_slot != SWAP_SLOT_NONE)
+        swap_free (page->swap_slot);
+}
+
+static void sup_page_delete(struct hash_elem *e, void *aux UNUSED){
     struct sup_pt_elem *page = hash_entry (e, struct sup_pt_elem, hash_elem);
-    free (page);
+    sup_page_release (page);
+    slab_free (page);
+}
+
+/* Creates T's empty supplemental page table.  Returns false if
+   memory for it cannot be allocated. */
+bool sup_page_table_init(struct thread *t){
+    return ohash_init (&t->sup_pages, sup_page_hash, sup_page_less, NULL);
+}
+
+/* Frees every entry of T's supplemental page table, along with
+   the frames and swap slots holding the pages.  Must be called
+   while T's page directory still exists. */
+void sup_page_table_destroy(struct thread *t){
+    ohash_destroy (&t->sup_pages, sup_page_delete);
 }
 
-struct sup_pt_elem* find_pt_elem(struct thread* t, const uint32_t* vaddr){
+struct sup_pt_elem* find_pt_elem(struct thread* t, const void* vaddr){
     struct sup_pt_elem page;
     struct hash_elem *e;
     page.vaddr=(uint32_t*)pg_round_down(vaddr);
-    e = hash_find (&t->sup_pages, &page.hash_elem);
+    e = ohash_find (&t->sup_pages, &page.hash_elem);
     if (e!=NULL)
     {
         return hash_entry(e,struct sup_pt_elem,hash_elem);
@@ -49,24 +107,309 @@ struct sup_pt_elem* find_pt_elem(struct thread* t, const uint32_t* vaddr){
     }
 
 }
-struct sup_pt_elem* sup_page_alloc(const uint32_t* vaddr){
-    struct sup_pt_elem* page=malloc(sizeof(struct sup_pt_elem));
+struct sup_pt_elem* sup_page_alloc(const void* vaddr){
+    struct sup_pt_elem* page=slab_alloc(&sup_pt_cache);
     
     if (page!=NULL)
     {
         page->vaddr=(uint32_t*)pg_round_down(vaddr);
         page->owner=thread_current();
         page->writable = true;
+        page->file = NULL;
+        page->ofs = 0;
+        page->read_bytes = 0;
+        page->mmap = false;
+        page->frame = NULL;
+        page->swap_slot = SWAP_SLOT_NONE;
 
-        if (hash_insert (&thread_current()->sup_pages, &page->hash_elem) != NULL)
+        if (ohash_insert (&thread_current()->sup_pages, &page->hash_elem) != NULL)
         {
-        
-          //printf("\n=%d\n",hash_entry(hash_insert (&thread_current()->sup_pages, &page->hash_elem),struct sup_pt_elem,hash_elem)->status);
-          free (page);
+          slab_free (page);
           page = NULL;
         }
     }
 
     return page;
     
-}
\ No newline at end of file
+}
+
+/* Adds UPAGE to the current process's supplemental page table,
+   backed by READ_BYTES bytes of FILE at OFS. */
+static bool sup_page_add(const void *upage, struct file *file, off_t ofs,
+                         size_t read_bytes, bool writable, bool mmap){
+    struct sup_pt_elem *page = sup_page_alloc (upage);
+
+    ASSERT (read_bytes <= PGSIZE);
+    if (page == NULL)
+        return false;
+    page->writable = writable;
+    page->file = read_bytes > 0 ? file : NULL;
+    page->ofs = ofs;
+    page->read_bytes = read_bytes;
+    page->mmap = mmap;
+    return true;
+}
+
+/* Records that UPAGE is to be filled from READ_BYTES bytes of
+   FILE starting at OFS, with the rest of the page zeroed, the
+   first time it is touched.  Returns false if UPAGE is already
+   recorded or memory is short. */
+bool sup_page_add_file(const void *upage, struct file *file, off_t ofs,
+                       size_t read_bytes, bool writable){
+    return sup_page_add (upage, file, ofs, read_bytes, writable, false);
+}
+
+/* Records that UPAGE maps READ_BYTES bytes of FILE starting at
+   OFS, with the rest of the page zeroed.  Unlike a page added by
+   sup_page_add_file(), the page is written back to FILE, if it
+   was modified, when it is evicted or unmapped. */
+bool sup_page_add_mmap(const void *upage, struct file *file, off_t ofs,
+                       size_t read_bytes){
+    return sup_page_add (upage, file, ofs, read_bytes, true, true);
+}
+
+/* Removes PAGE from its owner's address space and supplemental
+   page table, and frees it.  The owner must be the current
+   thread. */
+void sup_page_remove(struct sup_pt_elem *page){
+    sup_page_release (page);
+    ohash_delete (&page->owner->sup_pages, &page->hash_elem);
+    slab_free (page);
+}
+
+/* Reads PAGE's contents into KPAGE. */
+static bool sup_page_read(struct sup_pt_elem *page, uint8_t *kpage){
+    if (page->swap_slot != SWAP_SLOT_NONE)
+    {
+        swap_read (page->swap_slot, kpage);
+        swap_free (page->swap_slot);
+        page->swap_slot = SWAP_SLOT_NONE;
+        return true;
+    }
+    if (page->file != NULL)
+    {
+        /* The file system is serialized by the system call lock.
+           A fault from inside a system call is taken with it
+           already held; a fault from user code is not. */
+        bool held = holding_l ();
+        off_t n;
+
+        if (!held)
+            acquire_l ();
+        n = file_read_at (page->file, kpage, page->read_bytes, page->ofs);
+        if (!held)
+            release_l ();
+        if (n != (off_t) page->read_bytes)
+            return false;
+    }
+    memset (kpage + page->read_bytes, 0, PGSIZE - page->read_bytes);
+    return true;
+}
+
+/* Maps PAGE into frame F, which must hold its contents and to
+   which PAGE must be attached, and unpins F unless PIN is true.
+   A shared frame is mapped read-only, so that the first write
+   faults and gets a copy.  FROM_SWAP says whether the contents
+   came from swap. */
+static bool sup_page_map(struct sup_pt_elem *page, struct frame *f,
+                         bool from_swap, bool pin){
+    uint32_t *pd = page->owner->pagedir;
+    bool writable = page->writable && !frame_is_shared (f);
+
+    if (!pagedir_set_page (pd, page->vaddr, f->kpage, writable))
+    {
+        frame_unpin (f);
+        frame_free_page (page);
+        return false;
+    }
+    /* Its swap slot is gone, so the page must be written out
+       again if it is evicted, even if it is not modified. */
+    if (from_swap)
+        pagedir_set_dirty (pd, page->vaddr, true);
+    if (!pin)
+        frame_unpin (f);
+    return true;
+}
+
+/* Brings in the pages around PAGE that are also swapped out, as
+   long as free frames are at hand, on the bet that pages evicted
+   together are used together.  They are mapped with the accessed
+   bit clear, so that they are the first to go again if the bet
+   is wrong. */
+static void sup_page_read_around(struct sup_pt_elem *page){
+    const uint8_t *base = (const uint8_t *) page->vaddr;
+    int i;
+
+    for (i = -SWAP_READ_AROUND; i <= SWAP_READ_AROUND; i++)
+    {
+        const uint8_t *vaddr = base + i * PGSIZE;
+        struct sup_pt_elem *near;
+        struct frame *f;
+
+        if (i == 0 || !is_user_vaddr (vaddr))
+            continue;
+        near = find_pt_elem (page->owner, vaddr);
+        if (near == NULL || near->frame != NULL
+            || near->swap_slot == SWAP_SLOT_NONE)
+            continue;
+        f = frame_try_alloc ();
+        if (f == NULL)
+            break;
+        swap_read (near->swap_slot, f->kpage);
+        swap_free (near->swap_slot);
+        near->swap_slot = SWAP_SLOT_NONE;
+        frame_attach (f, near);
+        sup_page_map (near, f, true, false);
+    }
+}
+
+/* Brings PAGE into a frame and maps it.  The frame is left
+   pinned if PIN is true.  Unless WRITE is true, an all-zero page
+   is mapped to the zero frame, and a clean page of an executable
+   goes into the frame that other processes running the same file
+   already have it in, if there is one, and otherwise into a frame
+   that later ones can share.  Returns false if memory is exhausted
+   or the backing file can't be read. */
+static bool sup_page_load(struct sup_pt_elem *page, bool pin, bool write){
+    struct inode *inode = NULL;
+    struct frame *f;
+    bool from_swap;
+
+    if (!page->mmap && !write)
+    {
+        if (page->file == NULL)
+            f = frame_share_zero (page);
+        else
+        {
+            inode = file_get_inode (page->file);
+            f = frame_share (page, inode, page->ofs, page->read_bytes);
+        }
+        if (f != NULL)
+            return sup_page_map (page, f, false, pin);
+    }
+    f = frame_alloc ();
+    if (f == NULL)
+        return false;
+    /* Only look now: until frame_alloc() has taken the frame
+       table lock, the page may still be on its way out. */
+    from_swap = page->swap_slot != SWAP_SLOT_NONE;
+    if (!sup_page_read (page, f->kpage))
+    {
+        frame_free (f);
+        return false;
+    }
+    if (inode != NULL && !from_swap)
+        frame_publish (f, inode, page->ofs, page->read_bytes);
+    frame_attach (f, page);
+    if (!sup_page_map (page, f, from_swap, pin))
+        return false;
+    if (from_swap)
+        sup_page_read_around (page);
+    return true;
+}
+
+/* Gives PAGE, which must be resident and pinned, a frame of its
+   own and maps it writable, copying the shared frame unless PAGE
+   is the last page using it.  PAGE's new frame is left pinned.
+   Returns false if memory is exhausted. */
+static bool sup_page_unshare(struct sup_pt_elem *page){
+    uint32_t *pd = page->owner->pagedir;
+    struct frame *f = page->frame;
+
+    if (frame_unshare (page))
+        pagedir_clear_page (pd, page->vaddr);
+    else
+    {
+        f = frame_alloc ();
+        if (f == NULL)
+            return false;
+        memcpy (f->kpage, page->frame->kpage, PGSIZE);
+        frame_move (page, f);
+    }
+    return pagedir_set_page (pd, page->vaddr, f->kpage, true);
+}
+
+/* Returns true if an access to ADDR, by a process whose stack
+   pointer is ESP, looks like a stack access: within the stack
+   size limit, and at or above ESP, or up to 32 bytes below it, as
+   PUSHA checks its whole destination before moving ESP. */
+static bool is_stack_access(const void *addr, const void *esp){
+    const uint8_t *a = addr;
+
+    return (esp != NULL && is_user_vaddr (addr)
+            && a >= (const uint8_t *) PHYS_BASE - stack_max_pages * PGSIZE
+            && a + 32 >= (const uint8_t *) esp);
+}
+
+/* Returns the current process's page containing ADDR.  If there
+   is none but ADDR looks like a stack access given the user stack
+   pointer ESP, adds a zero-filled stack page for it first.
+   Returns a null pointer otherwise. */
+static struct sup_pt_elem *find_or_grow(const void *addr, const void *esp){
+    struct thread *t = thread_current ();
+    struct sup_pt_elem *page = find_pt_elem (t, addr);
+
+    if (page == NULL && is_stack_access (addr, esp))
+        page = sup_page_alloc (addr);
+    return page;
+}
+
+/* Brings in the current process's page containing FAULT_ADDR, if
+   its supplemental page table says where to find it, or grows the
+   stack to cover it if it is a stack access given the user stack
+   pointer ESP, or copies it if it is a shared page being written.
+   NOT_PRESENT is true if the page was not mapped, WRITE if the
+   faulting access was a write.  Returns true if the page is now
+   mapped, false if the fault is a genuine error. */
+bool sup_page_fault(const void *fault_addr, bool not_present, bool write,
+                    const void *esp){
+    struct thread *t = thread_current ();
+    struct sup_pt_elem *page;
+    bool success;
+
+    if (!is_user_vaddr (fault_addr) || t->pagedir == NULL)
+        return false;
+    if (!not_present && !write)
+        return false;
+    page = find_or_grow (fault_addr, esp);
+    if (page == NULL || (write && !page->writable))
+        return false;
+    /* The page may have been evicted since the fault. */
+    if (not_present || !frame_pin_page (page))
+        return sup_page_load (page, false, write);
+    success = sup_page_unshare (page);
+    frame_unpin (page->frame);
+    return success;
+}
+
+/* Makes the current process's page containing UADDR resident and
+   keeps it so until sup_page_unpin(), so that the kernel can
+   touch it while holding locks that the page fault handler may
+   need.  Returns false if UADDR is not a valid address, or WRITE
+   is true and the page is read-only. */
+bool sup_page_pin(const void *uaddr, bool write){
+    struct thread *t = thread_current ();
+    struct sup_pt_elem *page;
+
+    if (!is_user_vaddr (uaddr))
+        return false;
+    page = find_or_grow (uaddr, t->user_esp);
+    if (page == NULL || (write && !page->writable))
+        return false;
+    if (!frame_pin_page (page))
+        return sup_page_load (page, true, write);
+    if (write && frame_is_shared (page->frame) && !sup_page_unshare (page))
+    {
+        frame_unpin (page->frame);
+        return false;
+    }
+    return true;
+}
+
+/* Undoes sup_page_pin() on the page containing UADDR. */
+void sup_page_unpin(const void *uaddr){
+    struct sup_pt_elem *page = find_pt_elem (thread_current (), uaddr);
+
+    if (page != NULL && page->frame != NULL)
+        frame_unpin (page->frame);
+}
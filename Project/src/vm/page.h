@@ -0,0 +1,61 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
+
+struct thread;
+struct file;
+struct frame;
+
+/* Supplemental page table entry.
+   Records, for one page of a process's address space, where its
+   contents come from, so that the page can be brought in by the
+   page fault handler instead of at load time. */
+struct sup_pt_elem
+{
+    uint32_t *vaddr;            /* User virtual page. */
+    struct thread *owner;       /* Process owning the page. */
+    bool writable;              /* Whether user may write it. */
+    struct hash_elem hash_elem; /* Element in owner's sup_pages. */
+
+    /* Backing file: READ_BYTES bytes at OFS in FILE, followed
+       by PGSIZE - READ_BYTES zero bytes.  FILE is NULL for an
+       all-zero page. */
+    struct file *file;
+    off_t ofs;
+    size_t read_bytes;
+    bool mmap;                  /* True: written back to FILE, not swap. */
+
+    /* Where the page is now.  Protected by the frame table lock;
+       see vm/frame.c. */
+    struct frame *frame;        /* Frame holding it, if resident. */
+    struct list_elem frame_elem; /* Element in FRAME's pages. */
+    size_t swap_slot;           /* Swap slot holding it, if swapped out. */
+};
+
+/* Maximum size of a process's stack, in pages.
+   Controlled by kernel command-line option "-sl". */
+extern size_t stack_max_pages;
+
+void sup_page_init (void);
+bool sup_page_table_init (struct thread *);
+void sup_page_table_destroy (struct thread *);
+struct sup_pt_elem *find_pt_elem (struct thread *, const void *vaddr);
+struct sup_pt_elem *sup_page_alloc (const void *vaddr);
+bool sup_page_add_file (const void *upage, struct file *, off_t ofs,
+                        size_t read_bytes, bool writable);
+bool sup_page_add_mmap (const void *upage, struct file *, off_t ofs,
+                        size_t read_bytes);
+void sup_page_remove (struct sup_pt_elem *);
+void sup_page_write_back (struct sup_pt_elem *, const void *kpage);
+bool sup_page_fault (const void *fault_addr, bool not_present, bool write,
+                     const void *esp);
+bool sup_page_pin (const void *uaddr, bool write);
+void sup_page_unpin (const void *uaddr);
+
+#endif /* vm/page.h */
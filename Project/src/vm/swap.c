@@ -0,0 +1,75 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;     /* Swap device, or NULL. */
+static struct bitmap *swap_map;       /* Swap slots, one bit per page. */
+static struct lock swap_lock;         /* Protects swap_map. */
+
+/* Initializes the swap space.  Without a swap device, swap_alloc()
+   always fails, so only clean pages can be evicted. */
+void
+swap_init (void) 
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / PAGE_SECTORS;
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+}
+
+/* Allocates CNT consecutive free swap slots and returns the
+   first, or SWAP_SLOT_NONE if there is no such run.  Pages that
+   are evicted together get neighbouring slots, so that writing
+   them out, and later reading them back in, sweeps the disk in
+   one direction instead of seeking back and forth. */
+size_t
+swap_alloc (size_t cnt) 
+{
+  size_t slot;
+
+  if (cnt == 0)
+    return SWAP_SLOT_NONE;
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, cnt, false);
+  lock_release (&swap_lock);
+  return slot != BITMAP_ERROR ? slot : SWAP_SLOT_NONE;
+}
+
+/* Writes the page at KPAGE to swap slot SLOT, in one
+   multi-sector transfer. */
+void
+swap_write (size_t slot, const void *kpage) 
+{
+  ASSERT (bitmap_test (swap_map, slot));
+  block_write_multi (swap_device, slot * PAGE_SECTORS, PAGE_SECTORS, kpage);
+}
+
+/* Reads swap slot SLOT into KPAGE, in one multi-sector transfer.
+   The slot stays allocated. */
+void
+swap_read (size_t slot, void *kpage) 
+{
+  ASSERT (bitmap_test (swap_map, slot));
+  block_read_multi (swap_device, slot * PAGE_SECTORS, PAGE_SECTORS, kpage);
+}
+
+/* Frees swap slot SLOT. */
+void
+swap_free (size_t slot) 
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
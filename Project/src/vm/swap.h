@@ -0,0 +1,16 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A page-sized slot on the swap device. */
+#define SWAP_SLOT_NONE SIZE_MAX         /* No slot. */
+
+void swap_init (void);
+size_t swap_alloc (size_t cnt);
+void swap_write (size_t slot, const void *kpage);
+void swap_read (size_t slot, void *kpage);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */